@@ -11,6 +11,20 @@
 #include <map>
 #include <fstream>
 #include <sstream>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TINYOBJ_USE_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(_WIN32) || defined(__i386__) || defined(__x86_64__) || \
+    (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define TINYOBJ_LITTLE_ENDIAN
+#endif
 
 #include "tiny_obj_loader.h"
 
@@ -27,17 +41,103 @@ struct vertex_index {
   vertex_index(int vidx, int vtidx, int vnidx)
       : v_idx(vidx), vt_idx(vtidx), vn_idx(vnidx){}
 };
-// for std::map
-static inline bool operator<(const vertex_index &a, const vertex_index &b) {
-  if (a.v_idx != b.v_idx)
-    return (a.v_idx < b.v_idx);
-  if (a.vn_idx != b.vn_idx)
-    return (a.vn_idx < b.vn_idx);
-  if (a.vt_idx != b.vt_idx)
-    return (a.vt_idx < b.vt_idx);
-
-  return false;
-}
+
+// Open-addressing hash table from a face corner (v, vt, vn) to the index of
+// the vertex it produced. Slots are tagged with a generation number, so
+// clear() is O(1) and the table's storage is reused across face groups.
+class vertex_cache {
+public:
+  vertex_cache() : mask_(0), count_(0), generation_(1) { rehash(256); }
+
+  bool find(const vertex_index &key, unsigned int &value) const {
+    for (size_t i = hash(key) & mask_;; i = (i + 1) & mask_) {
+      const slot &s = slots_[i];
+      if (s.generation != generation_)
+        return false;
+      if (s.v_idx == key.v_idx && s.vn_idx == key.vn_idx &&
+          s.vt_idx == key.vt_idx) {
+        value = s.value;
+        return true;
+      }
+    }
+  }
+
+  // Assumes key is not already present (call find() first).
+  void insert(const vertex_index &key, unsigned int value) {
+    // Keep the load factor at or below 1/2 so probe chains stay short.
+    if (2 * (count_ + 1) > slots_.size())
+      rehash(2 * slots_.size());
+    place(key, value);
+    count_++;
+  }
+
+  void clear() {
+    count_ = 0;
+    if (++generation_ == 0) {
+      // Generation wrapped around; stale tags could alias, so wipe them.
+      for (size_t i = 0; i < slots_.size(); i++)
+        slots_[i].generation = 0;
+      generation_ = 1;
+    }
+  }
+
+private:
+  struct slot {
+    int v_idx, vt_idx, vn_idx;
+    unsigned int value;
+    unsigned int generation; // live only when equal to generation_
+  };
+
+  static size_t hash(const vertex_index &key) {
+    // Pack the triple into 64 bits and finish with a splitmix64 mixer.
+    unsigned long long h =
+        (static_cast<unsigned long long>(static_cast<unsigned int>(key.v_idx))
+         << 32) ^
+        (static_cast<unsigned long long>(static_cast<unsigned int>(key.vn_idx))
+         << 16) ^
+        static_cast<unsigned int>(key.vt_idx);
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return static_cast<size_t>(h);
+  }
+
+  void place(const vertex_index &key, unsigned int value) {
+    size_t i = hash(key) & mask_;
+    while (slots_[i].generation == generation_)
+      i = (i + 1) & mask_;
+    slot &s = slots_[i];
+    s.v_idx = key.v_idx;
+    s.vt_idx = key.vt_idx;
+    s.vn_idx = key.vn_idx;
+    s.value = value;
+    s.generation = generation_;
+  }
+
+  void rehash(size_t capacity) {
+    std::vector<slot> old;
+    old.swap(slots_);
+    slot empty = {0, 0, 0, 0, 0};
+    slots_.assign(capacity, empty);
+    mask_ = capacity - 1;
+
+    const unsigned int live = generation_;
+    generation_ = 1;
+    for (size_t i = 0; i < old.size(); i++) {
+      if (old[i].generation == live) {
+        vertex_index key(old[i].v_idx, old[i].vt_idx, old[i].vn_idx);
+        place(key, old[i].value);
+      }
+    }
+  }
+
+  std::vector<slot> slots_;
+  size_t mask_;
+  size_t count_;
+  unsigned int generation_;
+};
 
 struct obj_shape {
   std::vector<float> v;
@@ -67,9 +167,30 @@ static inline std::string parseString(const char *&token) {
   return s;
 }
 
+static inline bool isDigit(const char c) {
+  return static_cast<unsigned char>(c - '0') < 10;
+}
+
+// Like atoi(), without the locale and errno overhead. Stops at the first
+// non-digit, so it reads one component of an "i/j/k" triple.
+static inline int parseIntValue(const char *s) {
+  s += strspn(s, " \t");
+  bool negative = false;
+  if (*s == '+' || *s == '-') {
+    negative = (*s == '-');
+    s++;
+  }
+  int value = 0;
+  while (isDigit(*s)) {
+    value = value * 10 + (*s - '0');
+    s++;
+  }
+  return negative ? -value : value;
+}
+
 static inline int parseInt(const char *&token) {
   token += strspn(token, " \t");
-  int i = atoi(token);
+  int i = parseIntValue(token);
   token += strcspn(token, " \t\r");
   return i;
 }
@@ -102,7 +223,7 @@ static inline int parseInt(const char *&token) {
 //  - s >= s_end.
 //  - parse failure.
 // 
-static bool tryParseDouble(const char *s, const char *s_end, double *result)
+static inline bool tryParseDouble(const char *s, const char *s_end, double *result)
 {
     if (s >= s_end)
     {
@@ -217,6 +338,146 @@ assemble:
 fail:
     return false;
 }
+// Fast replacement for tryParseDouble(), accepting the same grammar.
+//
+// Digit runs are found with SSE2 (16 bytes at a time) and converted eight
+// digits at a time with SWAR arithmetic into a 64-bit integer mantissa.
+// When the mantissa fits in 53 bits and the decimal exponent is within
+// +-22, a single multiply or divide by an exact power of ten gives the
+// correctly rounded result (Clinger's fast path). Longer mantissas and
+// larger exponents fall back to strtod(), which is exact.
+
+static const double kExactPowersOf10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+// Number of consecutive ASCII digits at p, never reading at or past s_end.
+static inline size_t digitRun(const char *p, const char *s_end) {
+  size_t n = 0;
+#ifdef TINYOBJ_USE_SSE2
+  const __m128i below = _mm_set1_epi8('0' - 1);
+  const __m128i above = _mm_set1_epi8('9' + 1);
+  while (s_end - (p + n) >= 16) {
+    __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + n));
+    __m128i digits = _mm_and_si128(_mm_cmpgt_epi8(block, below),
+                                   _mm_cmplt_epi8(block, above));
+    unsigned int other =
+        ~static_cast<unsigned int>(_mm_movemask_epi8(digits)) & 0xFFFFu;
+    if (other) {
+#ifdef _MSC_VER
+      unsigned long first;
+      _BitScanForward(&first, other);
+      return n + first;
+#else
+      return n + static_cast<size_t>(__builtin_ctz(other));
+#endif
+    }
+    n += 16;
+  }
+#endif
+  while (p + n < s_end && isDigit(p[n]))
+    n++;
+  return n;
+}
+
+// Appends n digits at p to mantissa. The caller guarantees the total stays
+// within 19 digits, so this can't overflow.
+static inline void accumulateDigits(const char *p, size_t n,
+                                    unsigned long long &mantissa) {
+  size_t i = 0;
+#ifdef TINYOBJ_LITTLE_ENDIAN
+  for (; i + 8 <= n; i += 8) {
+    unsigned long long chunk;
+    memcpy(&chunk, p + i, 8);
+    chunk = ((chunk & 0x0F0F0F0F0F0F0F0FULL) * 2561) >> 8;
+    chunk = ((chunk & 0x00FF00FF00FF00FFULL) * 6553601) >> 16;
+    chunk = ((chunk & 0x0000FFFF0000FFFFULL) * 42949672960001ULL) >> 32;
+    mantissa = mantissa * 100000000ULL + chunk;
+  }
+#endif
+  for (; i < n; i++)
+    mantissa = mantissa * 10 + static_cast<unsigned int>(p[i] - '0');
+}
+
+static bool parseNumber(const char *s, const char *s_end, double *result) {
+  if (s >= s_end) {
+    return false;
+  }
+
+  const char *curr = s;
+  bool negative = false;
+  if (*curr == '+' || *curr == '-') {
+    negative = (*curr == '-');
+    curr++;
+  }
+
+  // A digit must come first: ".5" and "-.5" are rejected, as before.
+  size_t intDigits = digitRun(curr, s_end);
+  if (intDigits == 0) {
+    return false;
+  }
+  const char *intPart = curr;
+  curr += intDigits;
+
+  const char *fracPart = curr;
+  size_t fracDigits = 0;
+  if (curr != s_end && *curr == '.') {
+    curr++;
+    fracPart = curr;
+    fracDigits = digitRun(curr, s_end);
+    curr += fracDigits;
+  }
+
+  int exponent = 0;
+  if (curr != s_end && (*curr == 'e' || *curr == 'E')) {
+    curr++;
+    bool expNegative = false;
+    if (curr != s_end && (*curr == '+' || *curr == '-')) {
+      expNegative = (*curr == '-');
+      curr++;
+    }
+    size_t expDigits = digitRun(curr, s_end);
+    if (expDigits == 0) {
+      // Empty E is not allowed.
+      return false;
+    }
+    for (size_t i = 0; i < expDigits; i++) {
+      if (exponent < 100000)
+        exponent = exponent * 10 + (curr[i] - '0');
+    }
+    curr += expDigits;
+    if (expNegative)
+      exponent = -exponent;
+  }
+
+  if (intDigits + fracDigits <= 19) {
+    unsigned long long mantissa = 0;
+    accumulateDigits(intPart, intDigits, mantissa);
+    accumulateDigits(fracPart, fracDigits, mantissa);
+    const int e10 = exponent - static_cast<int>(fracDigits);
+
+    if (mantissa == 0) {
+      *result = negative ? -0.0 : 0.0;
+      return true;
+    }
+    if (mantissa <= (1ULL << 53) && e10 >= -22 && e10 <= 22) {
+      double value = static_cast<double>(mantissa);
+      if (e10 < 0)
+        value /= kExactPowersOf10[-e10];
+      else
+        value *= kExactPowersOf10[e10];
+      *result = negative ? -value : value;
+      return true;
+    }
+  }
+
+  // Exact fallback. The token isn't NUL terminated, so copy it out.
+  std::string text(s, curr);
+  *result = strtod(text.c_str(), NULL);
+  return true;
+}
+
 static inline float parseFloat(const char *&token) {
   token += strspn(token, " \t");
 #ifdef TINY_OBJ_LOADER_OLD_FLOAT_PARSER
@@ -225,7 +486,7 @@ static inline float parseFloat(const char *&token) {
 #else
   const char *end = token + strcspn(token, " \t\r");
   double val = 0.0;
-  tryParseDouble(token, end, &val);
+  parseNumber(token, end, &val);
   float f = static_cast<float>(val);
   token = end;
 #endif
@@ -250,7 +511,7 @@ static vertex_index parseTriple(const char *&token, int vsize, int vnsize,
                                 int vtsize) {
   vertex_index vi(-1);
 
-  vi.v_idx = fixIndex(atoi(token), vsize);
+  vi.v_idx = fixIndex(parseIntValue(token), vsize);
   token += strcspn(token, "/ \t\r");
   if (token[0] != '/') {
     return vi;
@@ -260,13 +521,13 @@ static vertex_index parseTriple(const char *&token, int vsize, int vnsize,
   // i//k
   if (token[0] == '/') {
     token++;
-    vi.vn_idx = fixIndex(atoi(token), vnsize);
+    vi.vn_idx = fixIndex(parseIntValue(token), vnsize);
     token += strcspn(token, "/ \t\r");
     return vi;
   }
 
   // i/j/k or i/j
-  vi.vt_idx = fixIndex(atoi(token), vtsize);
+  vi.vt_idx = fixIndex(parseIntValue(token), vtsize);
   token += strcspn(token, "/ \t\r");
   if (token[0] != '/') {
     return vi;
@@ -274,23 +535,22 @@ static vertex_index parseTriple(const char *&token, int vsize, int vnsize,
 
   // i/j/k
   token++; // skip '/'
-  vi.vn_idx = fixIndex(atoi(token), vnsize);
+  vi.vn_idx = fixIndex(parseIntValue(token), vnsize);
   token += strcspn(token, "/ \t\r");
   return vi;
 }
 
 static unsigned int
-updateVertex(std::map<vertex_index, unsigned int> &vertexCache,
+updateVertex(vertex_cache &vertexCache,
              std::vector<float> &positions, std::vector<float> &normals,
              std::vector<float> &texcoords,
              const std::vector<float> &in_positions,
              const std::vector<float> &in_normals,
              const std::vector<float> &in_texcoords, const vertex_index &i) {
-  const std::map<vertex_index, unsigned int>::iterator it = vertexCache.find(i);
-
-  if (it != vertexCache.end()) {
+  unsigned int cached;
+  if (vertexCache.find(i, cached)) {
     // found cache
-    return it->second;
+    return cached;
   }
 
   assert(in_positions.size() > static_cast<unsigned int>(3 * i.v_idx + 2));
@@ -311,7 +571,7 @@ updateVertex(std::map<vertex_index, unsigned int> &vertexCache,
   }
 
   unsigned int idx = static_cast<unsigned int>(positions.size() / 3 - 1);
-  vertexCache[i] = idx;
+  vertexCache.insert(i, idx);
 
   return idx;
 }
@@ -340,7 +600,7 @@ static void InitMaterial(material_t &material) {
 }
 
 static bool exportFaceGroupToShape(
-    shape_t &shape, std::map<vertex_index, unsigned int> vertexCache,
+    shape_t &shape, vertex_cache &vertexCache,
     const std::vector<float> &in_positions,
     const std::vector<float> &in_normals,
     const std::vector<float> &in_texcoords,
@@ -681,7 +941,7 @@ bool LoadObj(std::vector<shape_t> &shapes, // [output]
 
   // material
   std::map<std::string, int> material_map;
-  std::map<vertex_index, unsigned int> vertexCache;
+  vertex_cache vertexCache;
   int material = -1;
 
   shape_t shape;
@@ -897,4 +1157,402 @@ bool LoadObj(std::vector<shape_t> &shapes, // [output]
   return true;
 }
 
+// Records parsed from one line-aligned chunk of an .obj file by
+// LoadObjParallel. Face corners use chunk-local counts for relative
+// (negative) indices; those are flagged and offset when chunks are stitched.
+struct obj_directive {
+  size_t face;      // number of faces in the chunk preceding the directive
+  char kind;        // 'g', 'o', 'u'semtl or 'm'tllib
+  std::string text; // rest of the line, starting at the keyword
+};
+
+struct obj_chunk {
+  const char *begin, *end;
+  std::vector<float> v;
+  std::vector<float> vn;
+  std::vector<float> vt;
+  std::vector<vertex_index> corners;
+  std::vector<unsigned char> relative; // per corner: 1 v, 2 vt, 4 vn
+  std::vector<size_t> faceEnds;        // one past each face's last corner
+  std::vector<obj_directive> directives;
+};
+
+static inline int fixIndexChunk(int idx, int n, unsigned char &relative,
+                                unsigned char bit) {
+  if (idx < 0)
+    relative |= bit;
+  return fixIndex(idx, n);
+}
+
+// parseTriple() that also reports which indices were relative.
+static vertex_index parseTripleChunk(const char *&token, int vsize,
+                                     int vnsize, int vtsize,
+                                     unsigned char &relative) {
+  vertex_index vi(-1);
+  relative = 0;
+
+  vi.v_idx = fixIndexChunk(parseIntValue(token), vsize, relative, 1);
+  token += strcspn(token, "/ \t\r");
+  if (token[0] != '/') {
+    return vi;
+  }
+  token++;
+
+  // i//k
+  if (token[0] == '/') {
+    token++;
+    vi.vn_idx = fixIndexChunk(parseIntValue(token), vnsize, relative, 4);
+    token += strcspn(token, "/ \t\r");
+    return vi;
+  }
+
+  // i/j/k or i/j
+  vi.vt_idx = fixIndexChunk(parseIntValue(token), vtsize, relative, 2);
+  token += strcspn(token, "/ \t\r");
+  if (token[0] != '/') {
+    return vi;
+  }
+
+  // i/j/k
+  token++; // skip '/'
+  vi.vn_idx = fixIndexChunk(parseIntValue(token), vnsize, relative, 4);
+  token += strcspn(token, "/ \t\r");
+  return vi;
+}
+
+// Worker: parse the lines of one chunk. The chunk's newlines are replaced
+// by '\0' in place so the usual token parsers stop at the end of a line.
+static void parseObjChunk(obj_chunk *chunk) {
+  char *p = const_cast<char *>(chunk->begin);
+  char *const end = const_cast<char *>(chunk->end);
+
+  while (p < end) {
+    char *nl = static_cast<char *>(memchr(p, '\n', static_cast<size_t>(end - p)));
+    if (!nl)
+      nl = end;
+    *nl = '\0';
+    const char *token = p;
+    p = nl + 1;
+
+    token += strspn(token, " \t");
+    if (token[0] == '\0' || token[0] == '\r' || token[0] == '#')
+      continue;
+
+    // vertex
+    if (token[0] == 'v' && isSpace((token[1]))) {
+      token += 2;
+      float x, y, z;
+      parseFloat3(x, y, z, token);
+      chunk->v.push_back(x);
+      chunk->v.push_back(y);
+      chunk->v.push_back(z);
+      continue;
+    }
+
+    // normal
+    if (token[0] == 'v' && token[1] == 'n' && isSpace((token[2]))) {
+      token += 3;
+      float x, y, z;
+      parseFloat3(x, y, z, token);
+      chunk->vn.push_back(x);
+      chunk->vn.push_back(y);
+      chunk->vn.push_back(z);
+      continue;
+    }
+
+    // texcoord
+    if (token[0] == 'v' && token[1] == 't' && isSpace((token[2]))) {
+      token += 3;
+      float x, y;
+      parseFloat2(x, y, token);
+      chunk->vt.push_back(x);
+      chunk->vt.push_back(y);
+      continue;
+    }
+
+    // face
+    if (token[0] == 'f' && isSpace((token[1]))) {
+      token += 2;
+      token += strspn(token, " \t");
+
+      while (!isNewLine(token[0])) {
+        unsigned char relative;
+        vertex_index vi = parseTripleChunk(
+            token, static_cast<int>(chunk->v.size() / 3),
+            static_cast<int>(chunk->vn.size() / 3),
+            static_cast<int>(chunk->vt.size() / 2), relative);
+        chunk->corners.push_back(vi);
+        chunk->relative.push_back(relative);
+        size_t n = strspn(token, " \t\r");
+        token += n;
+      }
+
+      chunk->faceEnds.push_back(chunk->corners.size());
+      continue;
+    }
+
+    // Everything that changes shape/material state is replayed in order
+    // on the calling thread.
+    char kind = 0;
+    if ((0 == strncmp(token, "usemtl", 6)) && isSpace((token[6])))
+      kind = 'u';
+    else if ((0 == strncmp(token, "mtllib", 6)) && isSpace((token[6])))
+      kind = 'm';
+    else if (token[0] == 'g' && isSpace((token[1])))
+      kind = 'g';
+    else if (token[0] == 'o' && isSpace((token[1])))
+      kind = 'o';
+
+    if (kind) {
+      obj_directive d;
+      d.face = chunk->faceEnds.size();
+      d.kind = kind;
+      d.text = token;
+      // Trim newline '\r\n'
+      if (!d.text.empty() && d.text[d.text.size() - 1] == '\r')
+        d.text.erase(d.text.size() - 1);
+      chunk->directives.push_back(d);
+    }
+
+    // Ignore unknown command.
+  }
+}
+
+bool LoadObjParallel(std::vector<shape_t> &shapes, // [output]
+                     std::vector<material_t> &materials, // [output]
+                     std::string &err,
+                     const char *filename, const char *mtl_basepath,
+                     unsigned int num_threads) {
+
+  shapes.clear();
+
+  std::stringstream errss;
+
+  std::ifstream ifs(filename, std::ios::binary);
+  if (!ifs) {
+    errss << "Cannot open file [" << filename << "]" << std::endl;
+    err = errss.str();
+    return false;
+  }
+
+  std::string basePath;
+  if (mtl_basepath) {
+    basePath = mtl_basepath;
+  }
+  MaterialFileReader readMatFn(basePath);
+
+  // Read the whole file; chunks are parsed in place.
+  ifs.seekg(0, std::ios::end);
+  size_t size = static_cast<size_t>(ifs.tellg());
+  ifs.seekg(0, std::ios::beg);
+  std::vector<char> buf(size + 1);
+  if (size > 0)
+    ifs.read(&buf[0], static_cast<std::streamsize>(size));
+  buf[size] = '\0';
+
+  // Small files aren't worth the thread startup.
+  const size_t minChunkSize = 256 * 1024;
+  if (num_threads == 0)
+    num_threads = std::thread::hardware_concurrency();
+  if (num_threads == 0)
+    num_threads = 1;
+  size_t numChunks = size / minChunkSize;
+  if (numChunks > num_threads)
+    numChunks = num_threads;
+  if (numChunks < 1)
+    numChunks = 1;
+
+  // Split at line boundaries.
+  std::vector<obj_chunk> chunks(numChunks);
+  const char *data = &buf[0];
+  const char *cursor = data;
+  for (size_t i = 0; i < numChunks; i++) {
+    const char *target = data + (size * (i + 1)) / numChunks;
+    if (target < cursor)
+      target = cursor;
+    if (i + 1 < numChunks) {
+      const char *nl = static_cast<const char *>(
+          memchr(target, '\n', static_cast<size_t>(data + size - target)));
+      target = nl ? nl + 1 : data + size;
+    }
+    chunks[i].begin = cursor;
+    chunks[i].end = target;
+    cursor = target;
+  }
+
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < numChunks; i++)
+    workers.push_back(std::thread(parseObjChunk, &chunks[i]));
+  parseObjChunk(&chunks[0]);
+  for (size_t i = 0; i < workers.size(); i++)
+    workers[i].join();
+
+  // Stitch vertex data in file order.
+  std::vector<float> v;
+  std::vector<float> vn;
+  std::vector<float> vt;
+  {
+    size_t nv = 0, nvn = 0, nvt = 0;
+    for (size_t i = 0; i < numChunks; i++) {
+      nv += chunks[i].v.size();
+      nvn += chunks[i].vn.size();
+      nvt += chunks[i].vt.size();
+    }
+    v.reserve(nv);
+    vn.reserve(nvn);
+    vt.reserve(nvt);
+  }
+
+  std::vector<std::vector<vertex_index> > faceGroup;
+  std::string name;
+
+  // material
+  std::map<std::string, int> material_map;
+  vertex_cache vertexCache;
+  int material = -1;
+
+  shape_t shape;
+
+  // Replay faces and directives chunk by chunk, exactly as LoadObj would
+  // see them. Vertices of earlier chunks are already in v/vn/vt when a
+  // chunk's faces are stitched, so relative indices just need the offset.
+  for (size_t c = 0; c < numChunks; c++) {
+    obj_chunk &chunk = chunks[c];
+    const int vOffset = static_cast<int>(v.size() / 3);
+    const int vnOffset = static_cast<int>(vn.size() / 3);
+    const int vtOffset = static_cast<int>(vt.size() / 2);
+    v.insert(v.end(), chunk.v.begin(), chunk.v.end());
+    vn.insert(vn.end(), chunk.vn.begin(), chunk.vn.end());
+    vt.insert(vt.end(), chunk.vt.begin(), chunk.vt.end());
+
+    size_t corner = 0;
+    size_t d = 0;
+    for (size_t f = 0; f <= chunk.faceEnds.size(); f++) {
+      for (; d < chunk.directives.size() && chunk.directives[d].face == f; d++) {
+        const obj_directive &dir = chunk.directives[d];
+        const char *token = dir.text.c_str();
+
+        if (dir.kind == 'u') {
+          char namebuf[TINYOBJ_SSCANF_BUFFER_SIZE];
+          token += 7;
+#ifdef _MSC_VER
+          sscanf_s(token, "%s", namebuf, (unsigned)_countof(namebuf));
+#else
+          sscanf(token, "%s", namebuf);
+#endif
+
+          // Create face group per material.
+          bool ret = exportFaceGroupToShape(shape, vertexCache, v, vn, vt,
+                                            faceGroup, material, name, true);
+          if (ret) {
+            shapes.push_back(shape);
+          }
+          shape = shape_t();
+          faceGroup.clear();
+
+          if (material_map.find(namebuf) != material_map.end()) {
+            material = material_map[namebuf];
+          } else {
+            // { error!! material not found }
+            material = -1;
+          }
+        } else if (dir.kind == 'm') {
+          char namebuf[TINYOBJ_SSCANF_BUFFER_SIZE];
+          token += 7;
+#ifdef _MSC_VER
+          sscanf_s(token, "%s", namebuf, (unsigned)_countof(namebuf));
+#else
+          sscanf(token, "%s", namebuf);
+#endif
+
+          std::string err_mtl;
+          bool ok = readMatFn(namebuf, materials, material_map, err_mtl);
+          err += err_mtl;
+
+          if (!ok) {
+            faceGroup.clear(); // for safety
+            return false;
+          }
+        } else if (dir.kind == 'g') {
+          // flush previous face group.
+          bool ret = exportFaceGroupToShape(shape, vertexCache, v, vn, vt,
+                                            faceGroup, material, name, true);
+          if (ret) {
+            shapes.push_back(shape);
+          }
+
+          shape = shape_t();
+          faceGroup.clear();
+
+          std::vector<std::string> names;
+          while (!isNewLine(token[0])) {
+            std::string str = parseString(token);
+            names.push_back(str);
+            token += strspn(token, " \t\r"); // skip tag
+          }
+
+          assert(names.size() > 0);
+
+          // names[0] must be 'g', so skip the 0th element.
+          if (names.size() > 1) {
+            name = names[1];
+          } else {
+            name = "";
+          }
+        } else if (dir.kind == 'o') {
+          // flush previous face group.
+          bool ret = exportFaceGroupToShape(shape, vertexCache, v, vn, vt,
+                                            faceGroup, material, name, true);
+          if (ret) {
+            shapes.push_back(shape);
+          }
+
+          faceGroup.clear();
+          shape = shape_t();
+
+          char namebuf[TINYOBJ_SSCANF_BUFFER_SIZE];
+          token += 2;
+#ifdef _MSC_VER
+          sscanf_s(token, "%s", namebuf, (unsigned)_countof(namebuf));
+#else
+          sscanf(token, "%s", namebuf);
+#endif
+          name = std::string(namebuf);
+        }
+      }
+
+      if (f == chunk.faceEnds.size())
+        break;
+
+      std::vector<vertex_index> face;
+      face.reserve(chunk.faceEnds[f] - corner);
+      for (; corner < chunk.faceEnds[f]; corner++) {
+        vertex_index vi = chunk.corners[corner];
+        const unsigned char rel = chunk.relative[corner];
+        if (rel & 1)
+          vi.v_idx += vOffset;
+        if (rel & 2)
+          vi.vt_idx += vtOffset;
+        if (rel & 4)
+          vi.vn_idx += vnOffset;
+        face.push_back(vi);
+      }
+      faceGroup.push_back(face);
+    }
+
+    // Free the chunk's arrays as soon as they are merged.
+    chunk = obj_chunk();
+  }
+
+  bool ret = exportFaceGroupToShape(shape, vertexCache, v, vn, vt, faceGroup,
+                                    material, name, true);
+  if (ret) {
+    shapes.push_back(shape);
+  }
+  faceGroup.clear(); // for safety
+
+  err += errss.str();
+  return true;
+}
+
 } // namespace
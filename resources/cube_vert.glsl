@@ -3,11 +3,19 @@ layout (location = 0) in vec3 vertPos;
 
 out vec3 TexCoords;
 
-uniform mat4 P;
-uniform mat4 V;
 uniform mat4 M;
 
+// Per-frame camera data, shared by every program (see CameraBuffer.h)
+layout(std140) uniform Camera
+{
+	mat4 P;
+	mat4 V;
+	mat4 VP;
+	vec3 eye;
+	float time;
+};
+
 void main() {
 	TexCoords = vertPos;
-	gl_Position = P*V*M*vec4(vertPos.xyz, 1.0);
+	gl_Position = VP*M*vec4(vertPos.xyz, 1.0);
 }
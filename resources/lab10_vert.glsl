@@ -3,9 +3,18 @@
 layout(location = 0) in vec3 vertPos;
 layout(location = 1) in vec4 Pcolor;
 
-uniform mat4 P;
 uniform mat4 MV;
 
+// Per-frame camera data, shared by every program (see CameraBuffer.h)
+layout(std140) uniform Camera
+{
+	mat4 P;
+	mat4 V;
+	mat4 VP;
+	vec3 eye;
+	float time;
+};
+
 out vec4 partCol;
 
 
@@ -1,7 +1,6 @@
 #version 330 core
 
 uniform vec3 lightPos;
-uniform vec3 eye;
 uniform vec3 MatAmb;
 uniform vec3 MatDif;
 uniform vec3 MatSpec;
@@ -19,7 +18,7 @@ void main()
 	vec3 light = lightPos - vertPosition;
 	light = normalize(light);
 
-	vec3 eyeDir = normalize(eye - vertPosition);
+	vec3 eyeDir = normalize(eyePos - vertPosition);
 	vec3 H = normalize(light + eyeDir);
 
 	vec3 nNormal = normalize(normal);
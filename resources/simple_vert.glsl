@@ -3,9 +3,17 @@
 layout(location = 0) in vec4 vertPos;
 layout(location = 1) in vec3 vertNor;
 
-uniform mat4 P;
 uniform mat4 M;
-uniform mat4 V;
+
+// Per-frame camera data, shared by every program (see CameraBuffer.h)
+layout(std140) uniform Camera
+{
+	mat4 P;
+	mat4 V;
+	mat4 VP;
+	vec3 eye;
+	float time;
+};
 
 out vec3 normal;
 out vec3 vertPosition;
@@ -13,8 +21,9 @@ out vec3 eyePos;
 
 void main()
 {
-	gl_Position = P * V * M * vertPos;
+	gl_Position = VP * M * vertPos;
 	normal = (M * vec4(vertNor, 0)).xyz;
 
 	vertPosition = (M * vertPos).xyz;
+	eyePos = eye;
 }
\ No newline at end of file
@@ -2,9 +2,18 @@
 layout(location = 0) in vec3 vertPos;
 layout(location = 1) in vec3 vertNor;
 layout(location = 2) in vec2 vertTex;
-uniform mat4 P;
+layout(location = 3) in mat4 instM;
 uniform mat4 M;
-uniform mat4 V;
+
+/* Per-frame camera data, shared by every program (see CameraBuffer.h) */
+layout(std140) uniform Camera
+{
+	mat4 P;
+	mat4 V;
+	mat4 VP;
+	vec3 eye;
+	float time;
+};
 
 out vec2 vTexCoord;
 out vec3 fragNor;
@@ -12,11 +21,14 @@ out vec3 fragPos;
 out vec3 eyePos;
 
 void main() {
-    /* First model transforms */
-    gl_Position = P * V * M * vec4(vertPos.xyz, 1.0);
+    /* First model transforms, instM is identity for non-instanced draws */
+    mat4 model = M * instM;
+    gl_Position = VP * model * vec4(vertPos.xyz, 1.0);
+
+    fragNor = (model * vec4(vertNor, 1.0)).xyz;
+    fragPos = (model * vec4(vertPos, 1.0)).xyz;
 
-    fragNor = (M * vec4(vertNor, 1.0)).xyz;
-    fragPos = (M * vec4(vertPos, 1.0)).xyz;
+    eyePos = eye;
 
     /* pass through the texture coordinates to be interpolated */
     vTexCoord = vertTex;
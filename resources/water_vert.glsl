@@ -3,11 +3,19 @@
 layout(location = 0) in vec3 vertPos;
 layout(location = 1) in vec3 vertNor;
 
-uniform mat4 P;
-uniform mat4 V;
 uniform mat4 M;
 uniform vec3 lightPos;
 
+// Per-frame camera data, shared by every program (see CameraBuffer.h)
+layout(std140) uniform Camera
+{
+	mat4 P;
+	mat4 V;
+	mat4 VP;
+	vec3 eye;
+	float time;
+};
+
 out vec3 light_vector;
 out vec3 normal_vector;
 out vec3 halfway_vector;
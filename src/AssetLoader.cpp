@@ -0,0 +1,118 @@
+
+#include "AssetLoader.h"
+
+#include <chrono>
+
+#include "Profiler.h"
+
+
+AssetLoader::AssetLoader(unsigned int numThreads) :
+	outstanding(0)
+{
+	if (numThreads == 0)
+	{
+		unsigned int hardware = std::thread::hardware_concurrency();
+		numThreads = hardware > 1 ? hardware - 1 : 1;
+	}
+
+	for (unsigned int i = 0; i < numThreads; i++)
+	{
+		workers.push_back(std::thread(&AssetLoader::workerLoop, this));
+	}
+}
+
+AssetLoader::~AssetLoader()
+{
+	{
+		std::lock_guard<std::mutex> lock(jobsMutex);
+		stopping = true;
+	}
+	jobsReady.notify_all();
+
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		workers[i].join();
+	}
+}
+
+void AssetLoader::enqueue(std::function<void()> work, std::function<void()> upload)
+{
+	outstanding++;
+	{
+		std::lock_guard<std::mutex> lock(jobsMutex);
+		jobs.push_back({ work, upload });
+	}
+	jobsReady.notify_one();
+}
+
+void AssetLoader::workerLoop()
+{
+	PROFILE_THREAD("asset loader");
+
+	while (true)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(jobsMutex);
+			jobsReady.wait(lock, [this] { return stopping || !jobs.empty(); });
+			if (stopping)
+			{
+				return;
+			}
+			job = jobs.front();
+			jobs.pop_front();
+		}
+
+		if (job.work)
+		{
+			PROFILE_SCOPE("AssetLoader::work");
+			job.work();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(uploadsMutex);
+			uploads.push_back(job.upload);
+		}
+		uploadsReady.notify_one();
+	}
+}
+
+void AssetLoader::processUploads(double budget)
+{
+	typedef std::chrono::steady_clock Clock;
+	const Clock::time_point start = Clock::now();
+
+	do
+	{
+		std::function<void()> upload;
+		{
+			std::lock_guard<std::mutex> lock(uploadsMutex);
+			if (uploads.empty())
+			{
+				return;
+			}
+			upload = uploads.front();
+			uploads.pop_front();
+		}
+
+		if (upload)
+		{
+			PROFILE_SCOPE("AssetLoader::upload");
+			upload();
+		}
+		outstanding--;
+	}
+	while (std::chrono::duration<double>(Clock::now() - start).count() < budget);
+}
+
+void AssetLoader::finish()
+{
+	while (outstanding > 0)
+	{
+		{
+			std::unique_lock<std::mutex> lock(uploadsMutex);
+			uploadsReady.wait(lock, [this] { return !uploads.empty(); });
+		}
+		processUploads(1e9);
+	}
+}
@@ -0,0 +1,72 @@
+
+#pragma once
+
+#ifndef LAB471_ASSETLOADER_H_INCLUDED
+#define LAB471_ASSETLOADER_H_INCLUDED
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Loads assets in the background while the GL thread keeps rendering.
+//
+// Each job has two halves: the work (parsing an OBJ, decoding a JPEG) runs
+// on a worker thread and must not touch GL, then the upload (Shape::init,
+// Texture::upload, publishing the result to the scene) is queued for the
+// GL thread, which drains the queue a little every frame.
+class AssetLoader
+{
+
+public:
+
+	// 0 threads picks one less than the number of hardware threads
+	AssetLoader(unsigned int numThreads = 0);
+	~AssetLoader();
+
+	AssetLoader(const AssetLoader&) = delete;
+	AssetLoader& operator= (const AssetLoader&) = delete;
+
+	void enqueue(std::function<void()> work, std::function<void()> upload);
+
+	// Runs finished uploads on the calling thread until budget seconds have
+	// passed. At least one upload runs per call so loading always progresses.
+	void processUploads(double budget);
+
+	// Blocks, running uploads as they arrive, until every job has finished
+	void finish();
+
+	// True once every enqueued job has been uploaded
+	bool isIdle() const { return outstanding == 0; }
+
+private:
+
+	struct Job
+	{
+		std::function<void()> work;
+		std::function<void()> upload;
+	};
+
+	void workerLoop();
+
+	std::vector<std::thread> workers;
+
+	std::mutex jobsMutex;
+	std::condition_variable jobsReady;
+	std::deque<Job> jobs;
+	bool stopping = false;
+
+	std::mutex uploadsMutex;
+	std::condition_variable uploadsReady;
+	std::deque<std::function<void()>> uploads;
+
+	// Jobs enqueued but not yet uploaded
+	std::atomic<int> outstanding;
+
+};
+
+#endif // LAB471_ASSETLOADER_H_INCLUDED
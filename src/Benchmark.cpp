@@ -0,0 +1,189 @@
+
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+using namespace glm;
+
+
+bool CameraPath::load(const string &path, string &errStr)
+{
+	ifstream in(path);
+	if (!in)
+	{
+		errStr = "cannot open camera path " + path;
+		return false;
+	}
+
+	keys.clear();
+	string line;
+	int lineNumber = 0;
+	while (getline(in, line))
+	{
+		lineNumber++;
+		const size_t hash = line.find('#');
+		if (hash != string::npos)
+		{
+			line.erase(hash);
+		}
+		if (line.find_first_not_of(" \t\r") == string::npos)
+		{
+			continue;
+		}
+
+		Key key;
+		istringstream fields(line);
+		if (!(fields >> key.time >> key.eye.x >> key.eye.y >> key.eye.z >> key.theta >> key.phi))
+		{
+			errStr = path + ":" + to_string(lineNumber) + ": expected time eyeX eyeY eyeZ theta phi";
+			return false;
+		}
+		if (!keys.empty() && key.time <= keys.back().time)
+		{
+			errStr = path + ":" + to_string(lineNumber) + ": keyframe times must increase";
+			return false;
+		}
+		keys.push_back(key);
+	}
+
+	if (keys.empty())
+	{
+		errStr = "camera path " + path + " has no keyframes";
+		return false;
+	}
+	return true;
+}
+
+float CameraPath::duration() const
+{
+	return keys.empty() ? 0.0f : keys.back().time;
+}
+
+// Uniform Catmull-Rom between p1 and p2
+template <typename T>
+static T catmullRom(const T &p0, const T &p1, const T &p2, const T &p3, float s)
+{
+	const float s2 = s * s;
+	const float s3 = s2 * s;
+	return 0.5f * ((2.0f * p1) + (p2 - p0) * s + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * s2 + (3.0f * p1 - p0 - 3.0f * p2 + p3) * s3);
+}
+
+void CameraPath::sample(float t, vec3 &eye, float &theta, float &phi) const
+{
+	if (keys.empty())
+	{
+		return;
+	}
+
+	// Segment [i, i + 1] containing t
+	size_t i = 0;
+	while (i + 2 < keys.size() && keys[i + 1].time <= t)
+	{
+		i++;
+	}
+	if (keys.size() == 1 || t <= keys[0].time)
+	{
+		i = 0;
+		t = keys[0].time;
+	}
+
+	const Key &k1 = keys[i];
+	const Key &k2 = keys[min(i + 1, keys.size() - 1)];
+	const Key &k0 = keys[i > 0 ? i - 1 : i];
+	const Key &k3 = keys[min(i + 2, keys.size() - 1)];
+
+	const float span = k2.time - k1.time;
+	const float s = span > 0.0f ? glm::clamp((t - k1.time) / span, 0.0f, 1.0f) : 0.0f;
+
+	eye = catmullRom(k0.eye, k1.eye, k2.eye, k3.eye, s);
+	theta = catmullRom(k0.theta, k1.theta, k2.theta, k3.theta, s);
+	phi = catmullRom(k0.phi, k1.phi, k2.phi, k3.phi, s);
+}
+
+void BenchmarkReport::addFrame(double frameMs, double cpuMs, const RenderStats::Counters &counters)
+{
+	frameTimes.push_back(frameMs);
+	cpuTimes.push_back(cpuMs);
+	for (int i = 0; i < RenderStats::NumCounters; i++)
+	{
+		stats[i].push_back((double) counters.values[i]);
+	}
+}
+
+void BenchmarkReport::addGpuTimes(const vector<double> &gpuMs)
+{
+	gpuTimes.insert(gpuTimes.end(), gpuMs.begin(), gpuMs.end());
+}
+
+void BenchmarkReport::addGpuPass(const string &name, const vector<double> &gpuMs)
+{
+	gpuPasses.push_back(make_pair(name, gpuMs));
+}
+
+void BenchmarkReport::setField(const string &name, const string &json)
+{
+	fields.push_back(make_pair(name, json));
+}
+
+void BenchmarkReport::writeSummary(ostream &out, vector<double> values)
+{
+	if (values.empty())
+	{
+		out << "null";
+		return;
+	}
+
+	sort(values.begin(), values.end());
+	double sum = 0.0;
+	for (double v : values)
+	{
+		sum += v;
+	}
+
+	// Nearest rank
+	auto percentile = [&values](double p)
+	{
+		size_t rank = (size_t) ceil(p / 100.0 * values.size());
+		return values[rank > 0 ? rank - 1 : 0];
+	};
+
+	out << "{ \"min\": " << values.front()
+		<< ", \"mean\": " << sum / values.size()
+		<< ", \"p50\": " << percentile(50)
+		<< ", \"p95\": " << percentile(95)
+		<< ", \"p99\": " << percentile(99)
+		<< ", \"max\": " << values.back()
+		<< ", \"count\": " << values.size() << " }";
+}
+
+void BenchmarkReport::writeJSON(ostream &out) const
+{
+	out << "{\n";
+	for (const pair<string, string> &field : fields)
+	{
+		out << "  \"" << field.first << "\": " << field.second << ",\n";
+	}
+	out << "  \"frameTimeMs\": ";
+	writeSummary(out, frameTimes);
+	out << ",\n  \"cpuTimeMs\": ";
+	writeSummary(out, cpuTimes);
+	out << ",\n  \"gpuTimeMs\": ";
+	writeSummary(out, gpuTimes);
+	out << ",\n  \"gpuPassMs\": {";
+	for (size_t i = 0; i < gpuPasses.size(); i++)
+	{
+		out << (i ? "," : "") << "\n    \"" << gpuPasses[i].first << "\": ";
+		writeSummary(out, gpuPasses[i].second);
+	}
+	out << "\n  }";
+	for (int i = 0; i < RenderStats::NumCounters; i++)
+	{
+		out << ",\n  \"" << RenderStats::name((RenderStats::Counter) i) << "\": ";
+		writeSummary(out, stats[i]);
+	}
+	out << "\n}" << endl;
+}
@@ -0,0 +1,82 @@
+
+#pragma once
+
+#ifndef LAB471_BENCHMARK_H_INCLUDED
+#define LAB471_BENCHMARK_H_INCLUDED
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "RenderStats.h"
+
+
+// A scripted camera: keyframes of eye position and look angles, played back
+// along a Catmull-Rom spline. The file holds one keyframe per line,
+//
+//   time eyeX eyeY eyeZ theta phi
+//
+// with times in seconds, increasing. Blank lines and # comments are skipped.
+class CameraPath
+{
+
+public:
+
+	bool load(const std::string &path, std::string &errStr);
+
+	// Time of the last keyframe
+	float duration() const;
+
+	// Camera at time t, clamped to the path
+	void sample(float t, glm::vec3 &eye, float &theta, float &phi) const;
+
+	bool empty() const { return keys.empty(); }
+
+private:
+
+	struct Key
+	{
+		float time;
+		glm::vec3 eye;
+		float theta;
+		float phi;
+	};
+
+	std::vector<Key> keys;
+
+};
+
+// Per-frame measurements of a benchmark run, summarized as JSON
+class BenchmarkReport
+{
+
+public:
+
+	void addFrame(double frameMs, double cpuMs, const RenderStats::Counters &stats);
+	// GPU times arrive late and separately, from GpuProfiler: whole
+	// frames, and each pass of them
+	void addGpuTimes(const std::vector<double> &gpuMs);
+	void addGpuPass(const std::string &name, const std::vector<double> &gpuMs);
+
+	// Everything else in the report, written as-is (already JSON)
+	void setField(const std::string &name, const std::string &json);
+
+	void writeJSON(std::ostream &out) const;
+
+private:
+
+	// min, mean, p50, p95, p99 and max of values, as a JSON object
+	static void writeSummary(std::ostream &out, std::vector<double> values);
+
+	std::vector<double> frameTimes;
+	std::vector<double> cpuTimes;
+	std::vector<double> gpuTimes;
+	std::vector<double> stats[RenderStats::NumCounters];
+	std::vector<std::pair<std::string, std::vector<double>>> gpuPasses;
+	std::vector<std::pair<std::string, std::string>> fields;
+
+};
+
+#endif // LAB471_BENCHMARK_H_INCLUDED
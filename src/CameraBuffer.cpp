@@ -0,0 +1,40 @@
+
+#include "CameraBuffer.h"
+#include "GLSL.h"
+#include "GLState.h"
+#include "RenderStats.h"
+
+
+static_assert(sizeof(glm::mat4) == 64 && sizeof(glm::vec3) == 12, "Camera block layout assumes tightly packed glm types");
+
+CameraBuffer::~CameraBuffer()
+{
+	if (bufID)
+	{
+		GLState::deleteBuffer(bufID);
+	}
+}
+
+void CameraBuffer::init()
+{
+	CHECKED_GL_CALL(glGenBuffers(1, &bufID));
+	GLState::bindBuffer(GL_UNIFORM_BUFFER, bufID);
+	CHECKED_GL_CALL(glBufferData(GL_UNIFORM_BUFFER, sizeof(Block), nullptr, GL_DYNAMIC_DRAW));
+	GLState::bindBuffer(GL_UNIFORM_BUFFER, 0);
+	GLState::bindBufferBase(GL_UNIFORM_BUFFER, CameraBlockBinding, bufID);
+}
+
+void CameraBuffer::update(const glm::mat4 &P, const glm::mat4 &V, const glm::vec3 &eye, float time)
+{
+	Block block;
+	block.P = P;
+	block.V = V;
+	block.VP = P * V;
+	block.eye = eye;
+	block.time = time;
+
+	// Left bound; the state cache makes next frame's bind free
+	GLState::bindBuffer(GL_UNIFORM_BUFFER, bufID);
+	CHECKED_GL_CALL(glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Block), &block));
+	RenderStats::count(RenderStats::BufferBytes, sizeof(Block));
+}
@@ -0,0 +1,54 @@
+
+#pragma once
+
+#ifndef LAB471_CAMERABUFFER_H_INCLUDED
+#define LAB471_CAMERABUFFER_H_INCLUDED
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+
+// Name and binding point of the per-frame camera uniform block. Program
+// binds any block with this name to this point when it links.
+const char * const CameraBlockName = "Camera";
+const GLuint CameraBlockBinding = 0;
+
+// Per-frame camera data in a uniform buffer. Every shader declares
+//
+//   layout(std140) uniform Camera { mat4 P; mat4 V; mat4 VP; vec3 eye; float time; };
+//
+// so the matrices are uploaded once per frame rather than once per program.
+class CameraBuffer
+{
+
+public:
+
+	CameraBuffer() {}
+	~CameraBuffer();
+
+	CameraBuffer(const CameraBuffer&) = delete;
+	CameraBuffer& operator= (const CameraBuffer&) = delete;
+
+	// Creates the buffer and attaches it to CameraBlockBinding
+	void init();
+
+	// Computes VP and uploads the whole block
+	void update(const glm::mat4 &P, const glm::mat4 &V, const glm::vec3 &eye, float time);
+
+private:
+
+	// Matches the std140 layout of the Camera block
+	struct Block
+	{
+		glm::mat4 P;
+		glm::mat4 V;
+		glm::mat4 VP;
+		glm::vec3 eye;
+		float time;
+	};
+
+	GLuint bufID = 0;
+
+};
+
+#endif // LAB471_CAMERABUFFER_H_INCLUDED
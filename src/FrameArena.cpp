@@ -0,0 +1,67 @@
+
+#include "FrameArena.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+
+
+FrameArena::FrameArena(size_t capacity) :
+	block(static_cast<char *>(malloc(capacity))),
+	blockSize(block ? capacity : 0)
+{
+}
+
+FrameArena::~FrameArena()
+{
+	reset();
+	free(block);
+}
+
+void *FrameArena::allocate(size_t bytes, size_t alignment)
+{
+	uintptr_t base = reinterpret_cast<uintptr_t>(block);
+	size_t aligned = ((base + offset + alignment - 1) & ~(uintptr_t) (alignment - 1)) - base;
+	if (block && aligned + bytes <= blockSize)
+	{
+		offset = aligned + bytes;
+		return block + aligned;
+	}
+
+	// Out of room: take this one from the heap and remember to grow
+	char *extra = static_cast<char *>(malloc(bytes + alignment));
+	if (!extra)
+	{
+		throw std::bad_alloc();
+	}
+	overflow.push_back(extra);
+	overflowBytes += bytes + alignment;
+	uintptr_t p = (reinterpret_cast<uintptr_t>(extra) + alignment - 1) & ~(uintptr_t) (alignment - 1);
+	return reinterpret_cast<void *>(p);
+}
+
+void FrameArena::reset()
+{
+	if (!overflow.empty())
+	{
+		for (char *extra : overflow)
+		{
+			free(extra);
+		}
+		overflow.clear();
+
+		// Big enough for everything last frame needed, with some headroom
+		size_t needed = offset + overflowBytes;
+		size_t grown = std::max(needed + needed / 2, blockSize * 2);
+		char *bigger = static_cast<char *>(malloc(grown));
+		if (bigger)
+		{
+			free(block);
+			block = bigger;
+			blockSize = grown;
+		}
+	}
+
+	offset = 0;
+	overflowBytes = 0;
+}
@@ -0,0 +1,103 @@
+
+#pragma once
+
+#ifndef LAB471_FRAMEARENA_H_INCLUDED
+#define LAB471_FRAMEARENA_H_INCLUDED
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+
+// Bump allocator for data that only lives for one frame. Allocation is a
+// pointer increment, individual frees do nothing, and reset() at the start
+// of the next frame releases everything at once.
+//
+// If a frame outgrows the block the extra comes from the heap, and the next
+// reset() grows the block to fit, so the steady state allocates nothing.
+class FrameArena
+{
+
+public:
+
+	explicit FrameArena(size_t capacity = 1 << 20);
+	~FrameArena();
+
+	FrameArena(const FrameArena&) = delete;
+	FrameArena& operator= (const FrameArena&) = delete;
+
+	void *allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+	// Constructs a T in the arena. Its destructor is never run, so T should
+	// not own anything outside the arena.
+	template <typename T, typename... Args>
+	T *create(Args&&... args)
+	{
+		return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+	}
+
+	// Invalidates everything allocated since the last reset
+	void reset();
+
+	size_t used() const { return offset + overflowBytes; }
+	size_t capacity() const { return blockSize; }
+
+private:
+
+	char *block = nullptr;
+	size_t blockSize = 0;
+	size_t offset = 0;
+
+	// Heap blocks handed out after the main block filled up this frame
+	std::vector<char *> overflow;
+	size_t overflowBytes = 0;
+
+};
+
+// Standard allocator over a FrameArena, for containers that live one frame.
+// Without an arena it falls back to the heap.
+template <typename T>
+class ArenaAllocator
+{
+
+public:
+
+	typedef T value_type;
+
+	ArenaAllocator(FrameArena *arena = nullptr) noexcept : arena(arena) {}
+
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U> &other) noexcept : arena(other.arena) {}
+
+	T *allocate(size_t n)
+	{
+		if (arena)
+		{
+			return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T)));
+		}
+		return static_cast<T *>(::operator new(n * sizeof(T)));
+	}
+
+	void deallocate(T *p, size_t) noexcept
+	{
+		if (!arena)
+		{
+			::operator delete(p);
+		}
+	}
+
+	FrameArena *arena;
+
+};
+
+template <typename T, typename U>
+bool operator== (const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) { return a.arena == b.arena; }
+
+template <typename T, typename U>
+bool operator!= (const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) { return a.arena != b.arena; }
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+#endif // LAB471_FRAMEARENA_H_INCLUDED
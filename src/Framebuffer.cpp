@@ -0,0 +1,89 @@
+
+#include "Framebuffer.h"
+
+#include <cstring>
+#include <iostream>
+
+#include "GLSL.h"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+using namespace std;
+
+
+Framebuffer::~Framebuffer()
+{
+	if (fboID)
+	{
+		glDeleteFramebuffers(1, &fboID);
+		glDeleteRenderbuffers(1, &colorID);
+		glDeleteRenderbuffers(1, &depthID);
+	}
+}
+
+bool Framebuffer::init(int width, int height)
+{
+	this->width = width;
+	this->height = height;
+
+	CHECKED_GL_CALL(glGenRenderbuffers(1, &colorID));
+	CHECKED_GL_CALL(glBindRenderbuffer(GL_RENDERBUFFER, colorID));
+	CHECKED_GL_CALL(glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height));
+
+	CHECKED_GL_CALL(glGenRenderbuffers(1, &depthID));
+	CHECKED_GL_CALL(glBindRenderbuffer(GL_RENDERBUFFER, depthID));
+	CHECKED_GL_CALL(glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height));
+	CHECKED_GL_CALL(glBindRenderbuffer(GL_RENDERBUFFER, 0));
+
+	CHECKED_GL_CALL(glGenFramebuffers(1, &fboID));
+	CHECKED_GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, fboID));
+	CHECKED_GL_CALL(glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorID));
+	CHECKED_GL_CALL(glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthID));
+
+	const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		cerr << "Offscreen framebuffer is incomplete: 0x" << hex << status << dec << endl;
+		return false;
+	}
+	return true;
+}
+
+void Framebuffer::bind() const
+{
+	CHECKED_GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, fboID));
+}
+
+void Framebuffer::readPixels(vector<unsigned char> &pixels) const
+{
+	const size_t stride = (size_t) width * 4;
+	pixels.resize(stride * height);
+
+	CHECKED_GL_CALL(glBindFramebuffer(GL_READ_FRAMEBUFFER, fboID));
+	CHECKED_GL_CALL(glPixelStorei(GL_PACK_ALIGNMENT, 1));
+	CHECKED_GL_CALL(glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data()));
+
+	// GL returns the bottom row first
+	vector<unsigned char> row(stride);
+	for (int y = 0; y < height / 2; y++)
+	{
+		unsigned char *top = pixels.data() + y * stride;
+		unsigned char *bottom = pixels.data() + (height - 1 - y) * stride;
+		memcpy(row.data(), top, stride);
+		memcpy(top, bottom, stride);
+		memcpy(bottom, row.data(), stride);
+	}
+}
+
+bool Framebuffer::writePNG(const string &path) const
+{
+	vector<unsigned char> pixels;
+	readPixels(pixels);
+	if (!stbi_write_png(path.c_str(), width, height, 4, pixels.data(), width * 4))
+	{
+		cerr << "failed to write: " << path << endl;
+		return false;
+	}
+	return true;
+}
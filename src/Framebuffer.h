@@ -0,0 +1,51 @@
+
+#pragma once
+
+#ifndef LAB471_FRAMEBUFFER_H_INCLUDED
+#define LAB471_FRAMEBUFFER_H_INCLUDED
+
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+
+// An offscreen render target: RGBA8 color and 24-bit depth renderbuffers.
+// Used for headless runs, where the window is hidden and never presented.
+class Framebuffer
+{
+
+public:
+
+	Framebuffer() {}
+	~Framebuffer();
+
+	Framebuffer(const Framebuffer&) = delete;
+	Framebuffer& operator= (const Framebuffer&) = delete;
+
+	// False if the driver rejects the attachments
+	bool init(int width, int height);
+
+	// Directs rendering here
+	void bind() const;
+
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+
+	// Reads the color buffer back, top row first, 4 bytes per pixel
+	void readPixels(std::vector<unsigned char> &pixels) const;
+
+	// Reads the color buffer back and saves it as a PNG
+	bool writePNG(const std::string &path) const;
+
+private:
+
+	GLuint fboID = 0;
+	GLuint colorID = 0;
+	GLuint depthID = 0;
+	int width = 0;
+	int height = 0;
+
+};
+
+#endif // LAB471_FRAMEBUFFER_H_INCLUDED
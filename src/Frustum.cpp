@@ -0,0 +1,216 @@
+
+#include "Frustum.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define LAB471_FRUSTUM_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LAB471_FRUSTUM_SSE
+#endif
+
+using namespace glm;
+
+
+void BoundingSpheres::clear()
+{
+	x.clear();
+	y.clear();
+	z.clear();
+	radius.clear();
+}
+
+void BoundingSpheres::reserve(size_t n)
+{
+	x.reserve(n);
+	y.reserve(n);
+	z.reserve(n);
+	radius.reserve(n);
+}
+
+void BoundingSpheres::push_back(const vec3 &center, float r)
+{
+	x.push_back(center.x);
+	y.push_back(center.y);
+	z.push_back(center.z);
+	radius.push_back(r);
+}
+
+Frustum::Frustum(const mat4 &m)
+{
+	// Gribb & Hartmann: each plane is the last row plus or minus another row
+	vec4 row[4];
+	for (int i = 0; i < 4; i++)
+	{
+		row[i] = vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+	}
+
+	planes[0] = row[3] + row[0]; // left
+	planes[1] = row[3] - row[0]; // right
+	planes[2] = row[3] + row[1]; // bottom
+	planes[3] = row[3] - row[1]; // top
+	planes[4] = row[3] + row[2]; // near
+	planes[5] = row[3] - row[2]; // far
+
+	// Normalize so plane distances are comparable with sphere radii
+	for (int i = 0; i < 6; i++)
+	{
+		float len = length(vec3(planes[i].x, planes[i].y, planes[i].z));
+		if (len > 0.0f)
+		{
+			planes[i] = planes[i] / len;
+		}
+	}
+}
+
+bool Frustum::intersectsSphere(const vec3 &center, float radius) const
+{
+	for (int i = 0; i < 6; i++)
+	{
+		const vec4 &p = planes[i];
+		if (p.x * center.x + p.y * center.y + p.z * center.z + p.w < -radius)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool Frustum::intersectsBox(const vec3 &min, const vec3 &max) const
+{
+	for (int i = 0; i < 6; i++)
+	{
+		// The corner furthest along the plane normal
+		const vec4 &p = planes[i];
+		float x = p.x >= 0.0f ? max.x : min.x;
+		float y = p.y >= 0.0f ? max.y : min.y;
+		float z = p.z >= 0.0f ? max.z : min.z;
+		if (p.x * x + p.y * y + p.z * z + p.w < 0.0f)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+Frustum::Containment Frustum::classifyBox(const vec3 &min, const vec3 &max) const
+{
+	Containment result = INSIDE;
+	for (int i = 0; i < 6; i++)
+	{
+		// The corners furthest along and against the plane normal
+		const vec4 &p = planes[i];
+		vec3 pos = vec3(p.x >= 0.0f ? max.x : min.x, p.y >= 0.0f ? max.y : min.y, p.z >= 0.0f ? max.z : min.z);
+		vec3 neg = vec3(p.x >= 0.0f ? min.x : max.x, p.y >= 0.0f ? min.y : max.y, p.z >= 0.0f ? min.z : max.z);
+		if (p.x * pos.x + p.y * pos.y + p.z * pos.z + p.w < 0.0f)
+		{
+			return OUTSIDE;
+		}
+		if (p.x * neg.x + p.y * neg.y + p.z * neg.z + p.w < 0.0f)
+		{
+			result = INTERSECTS;
+		}
+	}
+	return result;
+}
+
+size_t Frustum::cull(const BoundingSpheres &spheres, std::vector<uint32_t> &visible) const
+{
+	visible.clear();
+	cull(spheres, 0, spheres.size(), visible);
+	return visible.size();
+}
+
+void Frustum::cull(const BoundingSpheres &spheres, size_t begin, size_t end, std::vector<uint32_t> &visible) const
+{
+	const size_t count = end;
+	const float *xs = spheres.x.data();
+	const float *ys = spheres.y.data();
+	const float *zs = spheres.z.data();
+	const float *rs = spheres.radius.data();
+
+	size_t i = begin;
+
+#if defined(LAB471_FRUSTUM_AVX)
+	__m256 px[6], py[6], pz[6], pw[6];
+	for (int p = 0; p < 6; p++)
+	{
+		px[p] = _mm256_set1_ps(planes[p].x);
+		py[p] = _mm256_set1_ps(planes[p].y);
+		pz[p] = _mm256_set1_ps(planes[p].z);
+		pw[p] = _mm256_set1_ps(planes[p].w);
+	}
+	const __m256 zero = _mm256_setzero_ps();
+
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 x = _mm256_loadu_ps(xs + i);
+		__m256 y = _mm256_loadu_ps(ys + i);
+		__m256 z = _mm256_loadu_ps(zs + i);
+		__m256 negR = _mm256_sub_ps(zero, _mm256_loadu_ps(rs + i));
+
+		// A sphere is out as soon as it is fully behind any one plane
+		__m256 outside = zero;
+		for (int p = 0; p < 6; p++)
+		{
+			__m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px[p], x), _mm256_mul_ps(py[p], y)),
+				_mm256_add_ps(_mm256_mul_ps(pz[p], z), pw[p]));
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(d, negR, _CMP_LT_OQ));
+		}
+
+		int mask = ~_mm256_movemask_ps(outside) & 0xff;
+		for (int b = 0; mask != 0; b++, mask >>= 1)
+		{
+			if (mask & 1)
+			{
+				visible.push_back((uint32_t) (i + b));
+			}
+		}
+	}
+#elif defined(LAB471_FRUSTUM_SSE)
+	__m128 px[6], py[6], pz[6], pw[6];
+	for (int p = 0; p < 6; p++)
+	{
+		px[p] = _mm_set1_ps(planes[p].x);
+		py[p] = _mm_set1_ps(planes[p].y);
+		pz[p] = _mm_set1_ps(planes[p].z);
+		pw[p] = _mm_set1_ps(planes[p].w);
+	}
+	const __m128 zero = _mm_setzero_ps();
+
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(xs + i);
+		__m128 y = _mm_loadu_ps(ys + i);
+		__m128 z = _mm_loadu_ps(zs + i);
+		__m128 negR = _mm_sub_ps(zero, _mm_loadu_ps(rs + i));
+
+		// A sphere is out as soon as it is fully behind any one plane
+		__m128 outside = zero;
+		for (int p = 0; p < 6; p++)
+		{
+			__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px[p], x), _mm_mul_ps(py[p], y)),
+				_mm_add_ps(_mm_mul_ps(pz[p], z), pw[p]));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(d, negR));
+		}
+
+		int mask = ~_mm_movemask_ps(outside) & 0xf;
+		for (int b = 0; mask != 0; b++, mask >>= 1)
+		{
+			if (mask & 1)
+			{
+				visible.push_back((uint32_t) (i + b));
+			}
+		}
+	}
+#endif
+
+	// Whatever doesn't fill a whole SIMD batch
+	for (; i < count; i++)
+	{
+		if (intersectsSphere(vec3(xs[i], ys[i], zs[i]), rs[i]))
+		{
+			visible.push_back((uint32_t) i);
+		}
+	}
+}
@@ -0,0 +1,62 @@
+
+#pragma once
+
+#ifndef LAB471_FRUSTUM_H_INCLUDED
+#define LAB471_FRUSTUM_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+
+// Bounding spheres stored as separate x/y/z/radius arrays so four (SSE) or
+// eight (AVX) of them can be tested against a plane at once
+struct BoundingSpheres
+{
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> z;
+	std::vector<float> radius;
+
+	size_t size() const { return x.size(); }
+	void clear();
+	void reserve(size_t n);
+	void push_back(const glm::vec3 &center, float r);
+};
+
+// A view frustum as six inward facing planes (xyz normal, w offset)
+class Frustum
+{
+
+public:
+
+	// Extracts the planes of a projection (times view, times model) matrix.
+	// The planes are in the space the matrix maps from, so passing P*V*M
+	// allows testing bounds in M's local space directly.
+	explicit Frustum(const glm::mat4 &m);
+
+	enum Containment
+	{
+		OUTSIDE,
+		INTERSECTS,
+		INSIDE
+	};
+
+	bool intersectsSphere(const glm::vec3 &center, float radius) const;
+	bool intersectsBox(const glm::vec3 &min, const glm::vec3 &max) const;
+	Containment classifyBox(const glm::vec3 &min, const glm::vec3 &max) const;
+
+	// Writes the index of every sphere at least partly inside to visible
+	// (which is cleared first) and returns how many there were. Sphere radii
+	// are only exact when the matrix has no non-uniform scale.
+	size_t cull(const BoundingSpheres &spheres, std::vector<uint32_t> &visible) const;
+	// Same for spheres [begin, end), appending to visible
+	void cull(const BoundingSpheres &spheres, size_t begin, size_t end, std::vector<uint32_t> &visible) const;
+
+	glm::vec4 planes[6];
+
+};
+
+#endif // LAB471_FRUSTUM_H_INCLUDED
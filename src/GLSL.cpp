@@ -10,10 +10,23 @@
 #include <iostream>
 #include <cstring>
 #include <cassert>
+#include <mutex>
+#include <vector>
 
 namespace GLSL
 {
 
+// Until setDebugLevel() is called, behave as before
+bool synchronousChecks = true;
+
+static DebugLevel currentLevel = DebugLevel::Synchronous;
+
+// Debug groups open when the driver raised each message. KHR_debug reports
+// pushes and pops in the same stream as everything else, so replaying them
+// here stays in step even when the callback runs on a driver thread.
+static std::mutex debugGroupsMutex;
+static std::vector<std::string> debugGroups;
+
 const char * errorString(GLenum err)
 {
 	switch (err) {
@@ -167,4 +180,180 @@ void vertexAttribPointer(const GLint handle, GLint size, GLenum type, GLboolean
 	}
 }
 
+void vertexAttribMat4Identity(const GLint handle)
+{
+	if (handle >= 0)
+	{
+		// A mat4 attribute occupies four consecutive column locations
+		for (GLint i = 0; i < 4; i++)
+		{
+			glVertexAttrib4f(handle + i, i == 0, i == 1, i == 2, i == 3);
+		}
+	}
+}
+
+bool parseDebugLevel(const std::string &name, DebugLevel &level)
+{
+	if (name == "off")
+	{
+		level = DebugLevel::Off;
+	}
+	else if (name == "callback")
+	{
+		level = DebugLevel::Callback;
+	}
+	else if (name == "sync")
+	{
+		level = DebugLevel::Synchronous;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+const char * debugLevelName(DebugLevel level)
+{
+	switch (level)
+	{
+	case DebugLevel::Off: return "off";
+	case DebugLevel::Callback: return "callback";
+	default: return "sync";
+	}
+}
+
+static const char * debugSourceString(GLenum source)
+{
+	switch (source)
+	{
+	case GL_DEBUG_SOURCE_API: return "API";
+	case GL_DEBUG_SOURCE_WINDOW_SYSTEM: return "window system";
+	case GL_DEBUG_SOURCE_SHADER_COMPILER: return "shader compiler";
+	case GL_DEBUG_SOURCE_THIRD_PARTY: return "third party";
+	case GL_DEBUG_SOURCE_APPLICATION: return "application";
+	default: return "other";
+	}
+}
+
+static const char * debugTypeString(GLenum type)
+{
+	switch (type)
+	{
+	case GL_DEBUG_TYPE_ERROR: return "error";
+	case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated";
+	case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "undefined behavior";
+	case GL_DEBUG_TYPE_PORTABILITY: return "portability";
+	case GL_DEBUG_TYPE_PERFORMANCE: return "performance";
+	case GL_DEBUG_TYPE_MARKER: return "marker";
+	default: return "other";
+	}
+}
+
+static const char * debugSeverityString(GLenum severity)
+{
+	switch (severity)
+	{
+	case GL_DEBUG_SEVERITY_HIGH: return "high";
+	case GL_DEBUG_SEVERITY_MEDIUM: return "medium";
+	case GL_DEBUG_SEVERITY_LOW: return "low";
+	default: return "notification";
+	}
+}
+
+static void APIENTRY debugCallback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar *message, const void *userParam)
+{
+	std::lock_guard<std::mutex> lock(debugGroupsMutex);
+
+	if (type == GL_DEBUG_TYPE_PUSH_GROUP)
+	{
+		debugGroups.push_back(message);
+		return;
+	}
+	if (type == GL_DEBUG_TYPE_POP_GROUP)
+	{
+		if (!debugGroups.empty())
+		{
+			debugGroups.pop_back();
+		}
+		return;
+	}
+
+	std::string where;
+	for (const std::string &group : debugGroups)
+	{
+		where += where.empty() ? " in " : " > ";
+		where += group;
+	}
+	printf("GL %s (%s, %s severity, id %u)%s: %s\n", debugTypeString(type), debugSourceString(source),
+		debugSeverityString(severity), id, where.c_str(), message);
+}
+
+void setDebugLevel(DebugLevel level)
+{
+	if (level == DebugLevel::Callback && !GLAD_GL_KHR_debug)
+	{
+		std::cerr << "WARN: KHR_debug is not available, GL errors will not be reported (try --gl-debug=sync)" << std::endl;
+		level = DebugLevel::Off;
+	}
+
+	currentLevel = level;
+	synchronousChecks = level == DebugLevel::Synchronous;
+
+	if (!GLAD_GL_KHR_debug)
+	{
+		return;
+	}
+
+	if (level == DebugLevel::Callback)
+	{
+		glDebugMessageCallback(debugCallback, nullptr);
+
+		// Everything except chatter, but keep the group markers, which the
+		// callback needs to track where messages come from
+		glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, GL_TRUE);
+		glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, GL_FALSE);
+		glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_PUSH_GROUP, GL_DONT_CARE, 0, nullptr, GL_TRUE);
+		glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_POP_GROUP, GL_DONT_CARE, 0, nullptr, GL_TRUE);
+
+		// Asynchronous on purpose: the driver need not stop for the callback
+		glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+		glEnable(GL_DEBUG_OUTPUT);
+	}
+	else
+	{
+		glDisable(GL_DEBUG_OUTPUT);
+	}
+}
+
+DebugLevel getDebugLevel()
+{
+	return currentLevel;
+}
+
+void ignoreDebugMessage(GLuint id)
+{
+	if (GLAD_GL_KHR_debug)
+	{
+		glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 1, &id, GL_FALSE);
+	}
+}
+
+DebugGroup::DebugGroup(const char *name) :
+	pushed(currentLevel == DebugLevel::Callback)
+{
+	if (pushed)
+	{
+		glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
+	}
+}
+
+DebugGroup::~DebugGroup()
+{
+	if (pushed)
+	{
+		glPopDebugGroup();
+	}
+}
+
 }
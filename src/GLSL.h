@@ -25,11 +25,51 @@ namespace GLSL
 	void enableVertexAttribArray(const GLint handle);
 	void disableVertexAttribArray(const GLint handle);
 	void vertexAttribPointer(const GLint handle, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid *pointer);
+	void vertexAttribMat4Identity(const GLint handle);
+
+	// How GL errors are reported. Callback uses KHR_debug, which the driver
+	// calls asynchronously, so it costs nothing per call; Synchronous checks
+	// glGetError around every CHECKED_GL_CALL, which stalls but pins errors
+	// to a line.
+	enum class DebugLevel
+	{
+		Off,
+		Callback,
+		Synchronous
+	};
+
+	// Parses "off", "callback" or "sync"
+	bool parseDebugLevel(const std::string &name, DebugLevel &level);
+	const char * debugLevelName(DebugLevel level);
+
+	// Needs a current context. Falls back to Off if Callback is asked for
+	// but KHR_debug is missing.
+	void setDebugLevel(DebugLevel level);
+	DebugLevel getDebugLevel();
+
+	// Stops the callback from reporting a driver message ID
+	void ignoreDebugMessage(GLuint id);
+
+	// Read by CHECKED_GL_CALL; set by setDebugLevel
+	extern bool synchronousChecks;
+
+	// Names the GL work done in its scope. Callback messages show the
+	// groups they were raised in.
+	class DebugGroup
+	{
+	public:
+		explicit DebugGroup(const char *name);
+		~DebugGroup();
+		DebugGroup(const DebugGroup&) = delete;
+		DebugGroup& operator= (const DebugGroup&) = delete;
+	private:
+		bool pushed;
+	};
 }
 
 
 #ifndef DISABLE_OPENGL_ERROR_CHECKS
-#define CHECKED_GL_CALL(x) do { GLSL::printOpenGLErrors("{{BEFORE}} "#x, __FILE__, __LINE__); (x); GLSL::printOpenGLErrors(#x, __FILE__, __LINE__); } while (0)
+#define CHECKED_GL_CALL(x) do { if (GLSL::synchronousChecks) GLSL::printOpenGLErrors("{{BEFORE}} "#x, __FILE__, __LINE__); (x); if (GLSL::synchronousChecks) GLSL::printOpenGLErrors(#x, __FILE__, __LINE__); } while (0)
 #else
 #define CHECKED_GL_CALL(x) (x)
 #endif
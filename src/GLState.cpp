@@ -0,0 +1,242 @@
+
+#include "GLState.h"
+
+#include "GLSL.h"
+#include "RenderStats.h"
+
+
+namespace GLState
+{
+
+	// Values no GL object has, so the first call of each kind is issued
+	static const GLuint Unknown = ~0u;
+	static const GLenum UnknownEnum = ~0u;
+
+	static const int MaxTextureUnits = 16;
+
+	// Buffer targets that are shadowed; others always pass through
+	enum BufferSlot
+	{
+		ArrayBuffer,
+		ElementArrayBuffer,
+		CopyWriteBuffer,
+		UniformBuffer,
+		NumBufferSlots
+	};
+
+	// Texture targets that are shadowed per unit
+	enum TextureSlot
+	{
+		Texture2D,
+		TextureCubeMap,
+		NumTextureSlots
+	};
+
+	static struct
+	{
+		GLuint program;
+		GLuint vertexArray;
+		GLuint buffers[NumBufferSlots];
+		GLint activeUnit;
+		GLuint textures[MaxTextureUnits][NumTextureSlots];
+		GLenum depthFunc;
+		GLenum polygonMode;
+	} state;
+
+	static void countIssued()
+	{
+		RenderStats::count(RenderStats::StateCallsIssued);
+	}
+
+	static void countFiltered()
+	{
+		RenderStats::count(RenderStats::StateCallsFiltered);
+	}
+
+	static bool initialized = false;
+
+	static void ensureInitialized()
+	{
+		if (!initialized)
+		{
+			invalidate();
+		}
+	}
+
+	static int bufferSlot(GLenum target)
+	{
+		switch (target)
+		{
+		case GL_ARRAY_BUFFER: return ArrayBuffer;
+		case GL_ELEMENT_ARRAY_BUFFER: return ElementArrayBuffer;
+		case GL_COPY_WRITE_BUFFER: return CopyWriteBuffer;
+		case GL_UNIFORM_BUFFER: return UniformBuffer;
+		default: return -1;
+		}
+	}
+
+	static int textureSlot(GLenum target)
+	{
+		switch (target)
+		{
+		case GL_TEXTURE_2D: return Texture2D;
+		case GL_TEXTURE_CUBE_MAP: return TextureCubeMap;
+		default: return -1;
+		}
+	}
+
+	// Stores value in cached and returns true if GL needs the call
+	template <typename T>
+	static bool change(T &cached, T value)
+	{
+		ensureInitialized();
+		if (cached == value)
+		{
+			countFiltered();
+			return false;
+		}
+		cached = value;
+		countIssued();
+		return true;
+	}
+
+	void useProgram(GLuint program)
+	{
+		if (change(state.program, program))
+		{
+			CHECKED_GL_CALL(glUseProgram(program));
+			RenderStats::count(RenderStats::ProgramBinds);
+		}
+	}
+
+	void bindVertexArray(GLuint vao)
+	{
+		if (change(state.vertexArray, vao))
+		{
+			CHECKED_GL_CALL(glBindVertexArray(vao));
+			// The element buffer binding belongs to the VAO
+			state.buffers[ElementArrayBuffer] = Unknown;
+		}
+	}
+
+	void bindBuffer(GLenum target, GLuint buffer)
+	{
+		const int slot = bufferSlot(target);
+		if (slot < 0)
+		{
+			countIssued();
+			CHECKED_GL_CALL(glBindBuffer(target, buffer));
+			return;
+		}
+		if (change(state.buffers[slot], buffer))
+		{
+			CHECKED_GL_CALL(glBindBuffer(target, buffer));
+		}
+	}
+
+	void bindBufferBase(GLenum target, GLuint index, GLuint buffer)
+	{
+		ensureInitialized();
+		countIssued();
+		CHECKED_GL_CALL(glBindBufferBase(target, index, buffer));
+
+		const int slot = bufferSlot(target);
+		if (slot >= 0)
+		{
+			state.buffers[slot] = buffer;
+		}
+	}
+
+	void deleteBuffer(GLuint buffer)
+	{
+		ensureInitialized();
+		CHECKED_GL_CALL(glDeleteBuffers(1, &buffer));
+
+		// GL unbinds a deleted buffer from the current context
+		for (int i = 0; i < NumBufferSlots; i++)
+		{
+			if (state.buffers[i] == buffer)
+			{
+				state.buffers[i] = 0;
+			}
+		}
+	}
+
+	void activeTexture(GLint unit)
+	{
+		if (change(state.activeUnit, unit))
+		{
+			CHECKED_GL_CALL(glActiveTexture(GL_TEXTURE0 + unit));
+		}
+	}
+
+	void bindTexture(GLenum target, GLuint texture)
+	{
+		ensureInitialized();
+		const int slot = textureSlot(target);
+		if (slot < 0 || state.activeUnit < 0 || state.activeUnit >= MaxTextureUnits)
+		{
+			countIssued();
+			CHECKED_GL_CALL(glBindTexture(target, texture));
+			RenderStats::count(RenderStats::TextureBinds);
+			return;
+		}
+		if (change(state.textures[state.activeUnit][slot], texture))
+		{
+			CHECKED_GL_CALL(glBindTexture(target, texture));
+			RenderStats::count(RenderStats::TextureBinds);
+		}
+	}
+
+	void bindTexture(GLint unit, GLenum target, GLuint texture)
+	{
+		ensureInitialized();
+		const int slot = textureSlot(target);
+		if (slot >= 0 && unit >= 0 && unit < MaxTextureUnits && state.textures[unit][slot] == texture)
+		{
+			countFiltered();
+			return;
+		}
+		activeTexture(unit);
+		bindTexture(target, texture);
+	}
+
+	void depthFunc(GLenum func)
+	{
+		if (change(state.depthFunc, func))
+		{
+			CHECKED_GL_CALL(glDepthFunc(func));
+		}
+	}
+
+	void polygonMode(GLenum face, GLenum mode)
+	{
+		// Core profile only accepts GL_FRONT_AND_BACK, so one value covers it
+		if (change(state.polygonMode, mode))
+		{
+			CHECKED_GL_CALL(glPolygonMode(face, mode));
+		}
+	}
+
+	void invalidate()
+	{
+		initialized = true;
+		state.program = Unknown;
+		state.vertexArray = Unknown;
+		for (int i = 0; i < NumBufferSlots; i++)
+		{
+			state.buffers[i] = Unknown;
+		}
+		state.activeUnit = -1;
+		for (int unit = 0; unit < MaxTextureUnits; unit++)
+		{
+			for (int i = 0; i < NumTextureSlots; i++)
+			{
+				state.textures[unit][i] = Unknown;
+			}
+		}
+		state.depthFunc = UnknownEnum;
+		state.polygonMode = UnknownEnum;
+	}
+
+}
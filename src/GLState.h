@@ -0,0 +1,39 @@
+
+#pragma once
+
+#ifndef LAB471_GLSTATE_H_INCLUDED
+#define LAB471_GLSTATE_H_INCLUDED
+
+#include <glad/glad.h>
+
+
+// Shadows the GL bindings the renderer changes most and drops calls that
+// would set what is already set. Everything that binds programs, VAOs,
+// buffers or textures should go through here, or the shadow goes stale;
+// call invalidate() after code that doesn't. Calls passed through and calls
+// dropped are counted in RenderStats. GL thread only.
+namespace GLState
+{
+
+	void useProgram(GLuint program);
+	void bindVertexArray(GLuint vao);
+	void bindBuffer(GLenum target, GLuint buffer);
+	// Also binds the buffer to target's generic binding, as GL does
+	void bindBufferBase(GLenum target, GLuint index, GLuint buffer);
+	void deleteBuffer(GLuint buffer);
+
+	// unit is an index (0, 1, ...), not GL_TEXTUREi
+	void activeTexture(GLint unit);
+	void bindTexture(GLenum target, GLuint texture);
+	// Binds texture to unit, switching the active unit only if it must
+	void bindTexture(GLint unit, GLenum target, GLuint texture);
+
+	void depthFunc(GLenum func);
+	void polygonMode(GLenum face, GLenum mode);
+
+	// Forgets every shadowed value, so the next call of each kind is issued
+	void invalidate();
+
+}
+
+#endif // LAB471_GLSTATE_H_INCLUDED
@@ -0,0 +1,207 @@
+
+#include "GpuProfiler.h"
+
+#include <cstdio>
+
+#include "GLSL.h"
+
+using namespace std;
+
+
+GpuProfiler::~GpuProfiler()
+{
+	for (Frame &frame : frames)
+	{
+		if (!frame.queries.empty())
+		{
+			glDeleteQueries((GLsizei) frame.queries.size(), frame.queries.data());
+		}
+	}
+}
+
+void GpuProfiler::init(int framesInFlight, int window)
+{
+	frames.resize(framesInFlight);
+	totalHistory.assign(window, 0.0);
+	for (Pass &pass : passes)
+	{
+		pass.history.assign(window, 0.0);
+	}
+}
+
+int GpuProfiler::addPass(const string &name)
+{
+	Pass pass;
+	pass.name = name;
+	pass.history.assign(totalHistory.size(), 0.0);
+	pass.frameTime = 0.0;
+	passes.push_back(pass);
+	return (int) passes.size() - 1;
+}
+
+void GpuProfiler::beginFrame()
+{
+	collect(false);
+	// Recorded frames are never skipped: wait for the oldest one instead.
+	// The GPU is then a whole ring of frames behind, so the CPU would soon
+	// block on it anyway.
+	if (recording && pending == frames.size())
+	{
+		collectFrame(frames[head], true);
+		head = (head + 1) % frames.size();
+		pending--;
+	}
+	measuring = pending < frames.size();
+	if (!measuring)
+	{
+		return;
+	}
+
+	Frame &frame = frames[current];
+	frame.scopes.clear();
+	frame.record = recording;
+}
+
+void GpuProfiler::begin(int pass)
+{
+	if (!measuring)
+	{
+		return;
+	}
+	end();
+
+	Frame &frame = frames[current];
+	if (frame.scopes.size() == frame.queries.size())
+	{
+		GLuint query;
+		CHECKED_GL_CALL(glGenQueries(1, &query));
+		frame.queries.push_back(query);
+	}
+	CHECKED_GL_CALL(glBeginQuery(GL_TIME_ELAPSED, frame.queries[frame.scopes.size()]));
+	frame.scopes.push_back(pass);
+	open = true;
+}
+
+void GpuProfiler::end()
+{
+	if (open)
+	{
+		CHECKED_GL_CALL(glEndQuery(GL_TIME_ELAPSED));
+		open = false;
+	}
+}
+
+void GpuProfiler::endFrame()
+{
+	if (!measuring)
+	{
+		return;
+	}
+	end();
+	measuring = false;
+
+	current = (current + 1) % frames.size();
+	pending++;
+}
+
+void GpuProfiler::finish()
+{
+	collect(true);
+}
+
+void GpuProfiler::collect(bool wait)
+{
+	while (pending > 0 && collectFrame(frames[head], wait))
+	{
+		head = (head + 1) % frames.size();
+		pending--;
+	}
+}
+
+bool GpuProfiler::collectFrame(Frame &frame, bool wait)
+{
+	// Queries finish in order, so the last one stands for the frame
+	if (!wait && !frame.scopes.empty())
+	{
+		GLint available = 0;
+		CHECKED_GL_CALL(glGetQueryObjectiv(frame.queries[frame.scopes.size() - 1], GL_QUERY_RESULT_AVAILABLE, &available));
+		if (!available)
+		{
+			return false;
+		}
+	}
+
+	for (Pass &pass : passes)
+	{
+		pass.frameTime = 0.0;
+	}
+	double total = 0.0;
+	for (size_t i = 0; i < frame.scopes.size(); i++)
+	{
+		GLuint64 nanoseconds = 0;
+		CHECKED_GL_CALL(glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &nanoseconds));
+		const double ms = nanoseconds * 1e-6;
+		passes[frame.scopes[i]].frameTime += ms;
+		total += ms;
+	}
+
+	for (Pass &pass : passes)
+	{
+		pass.history[historyPos] = pass.frameTime;
+		if (frame.record)
+		{
+			pass.recorded.push_back(pass.frameTime);
+		}
+	}
+	totalHistory[historyPos] = total;
+	if (frame.record)
+	{
+		totalRecorded.push_back(total);
+	}
+
+	historyPos = (historyPos + 1) % totalHistory.size();
+	if (historyCount < totalHistory.size())
+	{
+		historyCount++;
+	}
+	return true;
+}
+
+static double averageOf(const vector<double> &history, size_t count)
+{
+	if (count == 0)
+	{
+		return 0.0;
+	}
+
+	// Unfilled entries are zero
+	double sum = 0.0;
+	for (double ms : history)
+	{
+		sum += ms;
+	}
+	return sum / count;
+}
+
+double GpuProfiler::average(int pass) const
+{
+	return averageOf(passes[pass].history, historyCount);
+}
+
+double GpuProfiler::averageTotal() const
+{
+	return averageOf(totalHistory, historyCount);
+}
+
+void GpuProfiler::print(ostream &out) const
+{
+	out << "GPU ms:";
+	char number[32];
+	for (int i = 0; i < numPasses(); i++)
+	{
+		snprintf(number, sizeof(number), " %.3f,", average(i));
+		out << " " << passName(i) << number;
+	}
+	snprintf(number, sizeof(number), " %.3f", averageTotal());
+	out << " total" << number << endl;
+}
@@ -0,0 +1,109 @@
+
+#pragma once
+
+#ifndef LAB471_GPUPROFILER_H_INCLUDED
+#define LAB471_GPUPROFILER_H_INCLUDED
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+
+// Measures the GPU time of named passes with GL_TIME_ELAPSED queries
+// without stalling. Each frame's queries are read back a few frames later,
+// once the driver reports them available, and folded into rolling averages.
+//
+// Passes are timed back to back: begin() closes the previous pass's query,
+// so a frame is covered from its first begin() to end(). A pass may be
+// begun several times in a frame; its times add up.
+class GpuProfiler
+{
+
+public:
+
+	GpuProfiler() {}
+	~GpuProfiler();
+
+	GpuProfiler(const GpuProfiler&) = delete;
+	GpuProfiler& operator= (const GpuProfiler&) = delete;
+
+	// framesInFlight is how many frames may wait for results at once;
+	// averages cover the last window completed frames
+	void init(int framesInFlight = 4, int window = 60);
+
+	// Returns the id begin() takes. Passes are added before the first frame.
+	int addPass(const std::string &name);
+
+	// Collects finished frames. If every frame is still waiting, this one
+	// isn't measured, unless recording, which waits for the oldest instead.
+	void beginFrame();
+	void begin(int pass);
+	void end();
+	void endFrame();
+
+	// Blocks until every measured frame has finished
+	void finish();
+
+	int numPasses() const { return (int) passes.size(); }
+	const std::string & passName(int pass) const { return passes[pass].name; }
+
+	// Rolling average milliseconds of a pass, and of whole frames
+	double average(int pass) const;
+	double averageTotal() const;
+
+	// Rolling averages on one line: "GPU ms: sky 0.050, ... total 1.200"
+	void print(std::ostream &out) const;
+
+	// Frames begun while recording are always measured and keep their
+	// times, so reports cover exactly the recorded frames
+	void setRecording(bool enabled) { recording = enabled; }
+	// Milliseconds per recorded frame, oldest first
+	const std::vector<double> & recordedTimes(int pass) const { return passes[pass].recorded; }
+	const std::vector<double> & recordedTotals() const { return totalRecorded; }
+
+private:
+
+	struct Pass
+	{
+		std::string name;
+		// Last window frames' times, a ring indexed by historyPos
+		std::vector<double> history;
+		std::vector<double> recorded;
+		// This frame's time while it is being collected
+		double frameTime;
+	};
+
+	struct Frame
+	{
+		// One query per begin(), and the pass it timed
+		std::vector<GLuint> queries;
+		std::vector<int> scopes;
+		bool record;
+	};
+
+	// Collects frames in order until one isn't finished, or all of them
+	// when waiting
+	void collect(bool wait);
+	bool collectFrame(Frame &frame, bool wait);
+
+	std::vector<Pass> passes;
+	std::vector<double> totalHistory;
+	std::vector<double> totalRecorded;
+	size_t historyPos = 0;
+	size_t historyCount = 0;
+
+	// Ring of frames: oldest waiting, the one being measured, how many wait
+	std::vector<Frame> frames;
+	size_t head = 0;
+	size_t current = 0;
+	size_t pending = 0;
+
+	bool measuring = false;
+	bool open = false;
+	bool recording = false;
+
+};
+
+#endif // LAB471_GPUPROFILER_H_INCLUDED
@@ -0,0 +1,82 @@
+
+#include "HeapCounter.h"
+
+#include <cstdlib>
+#include <new>
+
+// Replaces the global allocation functions with malloc/free wrappers that
+// bump a thread-local counter. Plain thread_local integers need no
+// constructor, so this is safe during static initialization.
+
+namespace
+{
+	thread_local uint64_t allocations = 0;
+
+	void *countedAlloc(size_t size)
+	{
+		allocations++;
+		void *p = malloc(size ? size : 1);
+		if (!p)
+		{
+			throw std::bad_alloc();
+		}
+		return p;
+	}
+}
+
+uint64_t HeapCounter::threadAllocations()
+{
+	return allocations;
+}
+
+void *operator new(size_t size)
+{
+	return countedAlloc(size);
+}
+
+void *operator new[](size_t size)
+{
+	return countedAlloc(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+	allocations++;
+	return malloc(size ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+	allocations++;
+	return malloc(size ? size : 1);
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+	free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept
+{
+	free(p);
+}
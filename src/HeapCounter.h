@@ -0,0 +1,17 @@
+
+#pragma once
+
+#ifndef LAB471_HEAPCOUNTER_H_INCLUDED
+#define LAB471_HEAPCOUNTER_H_INCLUDED
+
+#include <cstdint>
+
+
+// Counts calls to the global operator new, per thread. Comparing the count
+// before and after a frame shows whether the render loop hit the heap.
+namespace HeapCounter
+{
+	uint64_t threadAllocations();
+}
+
+#endif // LAB471_HEAPCOUNTER_H_INCLUDED
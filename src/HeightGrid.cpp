@@ -0,0 +1,214 @@
+
+#include "HeightGrid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LAB471_HEIGHTGRID_SSE
+#endif
+
+using namespace std;
+using namespace glm;
+
+
+void HeightGrid::build(const float *positions, size_t numVertices, const unsigned int *indices, size_t numIndices, float gridSpacing)
+{
+	heights.clear();
+	dimX = dimZ = 0;
+	if (numVertices == 0)
+	{
+		return;
+	}
+
+	vec2 lo = vec2(numeric_limits<float>::max());
+	vec2 hi = vec2(-numeric_limits<float>::max());
+	for (size_t v = 0; v < numVertices; v++)
+	{
+		lo = min(lo, vec2(positions[3*v+0], positions[3*v+2]));
+		hi = max(hi, vec2(positions[3*v+0], positions[3*v+2]));
+	}
+
+	spacing = gridSpacing;
+	invSpacing = 1.0f / spacing;
+	origin = lo;
+	dimX = (int) ceil((hi.x - lo.x) * invSpacing) + 1;
+	dimZ = (int) ceil((hi.y - lo.y) * invSpacing) + 1;
+
+	const float unset = numeric_limits<float>::quiet_NaN();
+	heights.assign((size_t) dimX * dimZ, unset);
+
+	// Every grid point inside a triangle (in XZ) gets the interpolated height
+	for (size_t i = 0; i + 2 < numIndices; i += 3)
+	{
+		const float *p0 = positions + 3 * indices[i+0];
+		const float *p1 = positions + 3 * indices[i+1];
+		const float *p2 = positions + 3 * indices[i+2];
+		const vec2 a = vec2(p0[0], p0[2]);
+		const vec2 b = vec2(p1[0], p1[2]);
+		const vec2 c = vec2(p2[0], p2[2]);
+
+		const float area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+		if (fabs(area) < 1e-12f)
+		{
+			continue;
+		}
+		const float invArea = 1.0f / area;
+
+		const int x0 = std::max(0, (int) floor((std::min(a.x, std::min(b.x, c.x)) - origin.x) * invSpacing));
+		const int x1 = std::min(dimX - 1, (int) ceil((std::max(a.x, std::max(b.x, c.x)) - origin.x) * invSpacing));
+		const int z0 = std::max(0, (int) floor((std::min(a.y, std::min(b.y, c.y)) - origin.y) * invSpacing));
+		const int z1 = std::min(dimZ - 1, (int) ceil((std::max(a.y, std::max(b.y, c.y)) - origin.y) * invSpacing));
+
+		for (int iz = z0; iz <= z1; iz++)
+		{
+			for (int ix = x0; ix <= x1; ix++)
+			{
+				const vec2 p = origin + vec2(ix * spacing, iz * spacing);
+				const float w1 = ((p.x - a.x) * (c.y - a.y) - (c.x - a.x) * (p.y - a.y)) * invArea;
+				const float w2 = ((b.x - a.x) * (p.y - a.y) - (p.x - a.x) * (b.y - a.y)) * invArea;
+				const float w0 = 1.0f - w1 - w2;
+				const float eps = -1e-5f;
+				if (w0 >= eps && w1 >= eps && w2 >= eps)
+				{
+					heights[(size_t) iz * dimX + ix] = w0 * p0[1] + w1 * p1[1] + w2 * p2[1];
+				}
+			}
+		}
+	}
+
+	// Grow the covered area outwards until every point has a height
+	bool missing = true;
+	for (int pass = 0; missing && pass < dimX + dimZ; pass++)
+	{
+		missing = false;
+		vector<float> next = heights;
+		for (int iz = 0; iz < dimZ; iz++)
+		{
+			for (int ix = 0; ix < dimX; ix++)
+			{
+				if (!std::isnan(at(ix, iz)))
+				{
+					continue;
+				}
+				float sum = 0.0f;
+				int count = 0;
+				const int nx[4] = { ix - 1, ix + 1, ix, ix };
+				const int nz[4] = { iz, iz, iz - 1, iz + 1 };
+				for (int n = 0; n < 4; n++)
+				{
+					if (nx[n] >= 0 && nx[n] < dimX && nz[n] >= 0 && nz[n] < dimZ && !std::isnan(at(nx[n], nz[n])))
+					{
+						sum += at(nx[n], nz[n]);
+						count++;
+					}
+				}
+				if (count > 0)
+				{
+					next[(size_t) iz * dimX + ix] = sum / count;
+				}
+				else
+				{
+					missing = true;
+				}
+			}
+		}
+		heights.swap(next);
+	}
+
+	// Only possible without any usable triangle
+	for (float &h : heights)
+	{
+		if (std::isnan(h))
+		{
+			h = 0.0f;
+		}
+	}
+}
+
+float HeightGrid::sample(float x, float z) const
+{
+	if (heights.empty())
+	{
+		return 0.0f;
+	}
+
+	// Clamp so the 2x2 footprint always stays inside the grid
+	const float fx = std::min(std::max((x - origin.x) * invSpacing, 0.0f), std::max(dimX - 1.0f, 0.0f));
+	const float fz = std::min(std::max((z - origin.y) * invSpacing, 0.0f), std::max(dimZ - 1.0f, 0.0f));
+	const int ix = std::min((int) fx, std::max(dimX - 2, 0));
+	const int iz = std::min((int) fz, std::max(dimZ - 2, 0));
+	const int ix1 = std::min(ix + 1, dimX - 1);
+	const int iz1 = std::min(iz + 1, dimZ - 1);
+	const float tx = fx - ix;
+	const float tz = fz - iz;
+
+	const float h0 = at(ix, iz) + (at(ix1, iz) - at(ix, iz)) * tx;
+	const float h1 = at(ix, iz1) + (at(ix1, iz1) - at(ix, iz1)) * tx;
+	return h0 + (h1 - h0) * tz;
+}
+
+void HeightGrid::sample(const float *x, const float *z, float *out, size_t count) const
+{
+	size_t i = 0;
+
+#if defined(LAB471_HEIGHTGRID_SSE)
+	if (dimX >= 2 && dimZ >= 2)
+	{
+		const __m128 originX = _mm_set1_ps(origin.x);
+		const __m128 originZ = _mm_set1_ps(origin.y);
+		const __m128 scale = _mm_set1_ps(invSpacing);
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 maxX = _mm_set1_ps(dimX - 1.0f);
+		const __m128 maxZ = _mm_set1_ps(dimZ - 1.0f);
+		const __m128i lastX = _mm_set1_epi32(dimX - 2);
+		const __m128i lastZ = _mm_set1_epi32(dimZ - 2);
+
+		for (; i + 4 <= count; i += 4)
+		{
+			// Grid coordinates, clamped; truncation is floor once non-negative
+			__m128 fx = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(x + i), originX), scale), zero), maxX);
+			__m128 fz = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(z + i), originZ), scale), zero), maxZ);
+			__m128i ix = _mm_cvttps_epi32(fx);
+			__m128i iz = _mm_cvttps_epi32(fz);
+
+			// SSE2 has no 32-bit integer min; an index can only be one past
+			// the last cell (on the far edge), so add the -1 compare mask
+			ix = _mm_add_epi32(ix, _mm_cmpgt_epi32(ix, lastX));
+			iz = _mm_add_epi32(iz, _mm_cmpgt_epi32(iz, lastZ));
+			__m128 tx = _mm_sub_ps(fx, _mm_cvtepi32_ps(ix));
+			__m128 tz = _mm_sub_ps(fz, _mm_cvtepi32_ps(iz));
+
+			// No gather before AVX2: fetch the four corners lane by lane
+			alignas(16) int ixs[4];
+			alignas(16) int izs[4];
+			_mm_store_si128((__m128i *) ixs, ix);
+			_mm_store_si128((__m128i *) izs, iz);
+			alignas(16) float c00[4], c10[4], c01[4], c11[4];
+			for (int lane = 0; lane < 4; lane++)
+			{
+				const float *row = &heights[(size_t) izs[lane] * dimX + ixs[lane]];
+				c00[lane] = row[0];
+				c10[lane] = row[1];
+				c01[lane] = row[dimX];
+				c11[lane] = row[dimX + 1];
+			}
+
+			__m128 h00 = _mm_load_ps(c00);
+			__m128 h10 = _mm_load_ps(c10);
+			__m128 h01 = _mm_load_ps(c01);
+			__m128 h11 = _mm_load_ps(c11);
+			__m128 h0 = _mm_add_ps(h00, _mm_mul_ps(_mm_sub_ps(h10, h00), tx));
+			__m128 h1 = _mm_add_ps(h01, _mm_mul_ps(_mm_sub_ps(h11, h01), tx));
+			_mm_storeu_ps(out + i, _mm_add_ps(h0, _mm_mul_ps(_mm_sub_ps(h1, h0), tz)));
+		}
+	}
+#endif
+
+	for (; i < count; i++)
+	{
+		out[i] = sample(x[i], z[i]);
+	}
+}
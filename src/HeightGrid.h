@@ -0,0 +1,46 @@
+
+#pragma once
+
+#ifndef LAB471_HEIGHTGRID_H_INCLUDED
+#define LAB471_HEIGHTGRID_H_INCLUDED
+
+#include <cstddef>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+
+// Terrain heights resampled onto a regular XZ grid, so a lookup anywhere on
+// the terrain is a clamp, four loads and a bilinear blend.
+class HeightGrid
+{
+
+public:
+
+	// Rasterizes the triangles of a mesh into a grid with the given spacing.
+	// Grid points outside every triangle take their nearest neighbour's height.
+	void build(const float *positions, size_t numVertices, const unsigned int *indices, size_t numIndices, float spacing = 1.0f);
+
+	bool empty() const { return heights.empty(); }
+
+	// Height at (x, z), clamped to the edge outside the grid. 0 when empty.
+	float sample(float x, float z) const;
+
+	// Heights at count points at once; SIMD where available
+	void sample(const float *x, const float *z, float *out, size_t count) const;
+
+private:
+
+	float at(int ix, int iz) const { return heights[(size_t) iz * dimX + ix]; }
+
+	glm::vec2 origin = glm::vec2(0);
+	float spacing = 1.0f;
+	float invSpacing = 1.0f;
+	int dimX = 0;
+	int dimZ = 0;
+	// Row-major, dimX values per row of constant z
+	std::vector<float> heights;
+
+};
+
+#endif // LAB471_HEIGHTGRID_H_INCLUDED
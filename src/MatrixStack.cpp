@@ -1,75 +1,160 @@
 
 #include "MatrixStack.h"
+
+#include <cassert>
+#include <cmath>
 #include <glm/gtc/matrix_transform.hpp>
 
-static const int MaxMatrixSize = 100;
+#if defined(__AVX__)
+#include <immintrin.h>
+#define LAB471_MATRIXSTACK_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LAB471_MATRIXSTACK_SSE
+#endif
+
+
+// a = a * b. Every column of a is read before anything is written, so b may
+// alias a.
+static void multiplyInPlace(glm::mat4 &a, const glm::mat4 &b)
+{
+	float *r = &a[0][0];
+	const float *m = &b[0][0];
+
+#if defined(LAB471_MATRIXSTACK_AVX)
+	// Two result columns per pass, one in each 128-bit lane
+	const __m256 a0 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(r));
+	const __m256 a1 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(r + 4));
+	const __m256 a2 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(r + 8));
+	const __m256 a3 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(r + 12));
+	for (int j = 0; j < 16; j += 8)
+	{
+		__m256 col = _mm256_loadu_ps(m + j);
+		__m256 sum = _mm256_mul_ps(a0, _mm256_shuffle_ps(col, col, 0x00));
+		sum = _mm256_add_ps(sum, _mm256_mul_ps(a1, _mm256_shuffle_ps(col, col, 0x55)));
+		sum = _mm256_add_ps(sum, _mm256_mul_ps(a2, _mm256_shuffle_ps(col, col, 0xaa)));
+		sum = _mm256_add_ps(sum, _mm256_mul_ps(a3, _mm256_shuffle_ps(col, col, 0xff)));
+		_mm256_storeu_ps(r + j, sum);
+	}
+#elif defined(LAB471_MATRIXSTACK_SSE)
+	const __m128 a0 = _mm_loadu_ps(r);
+	const __m128 a1 = _mm_loadu_ps(r + 4);
+	const __m128 a2 = _mm_loadu_ps(r + 8);
+	const __m128 a3 = _mm_loadu_ps(r + 12);
+	for (int j = 0; j < 16; j += 4)
+	{
+		__m128 col = _mm_loadu_ps(m + j);
+		__m128 sum = _mm_mul_ps(a0, _mm_shuffle_ps(col, col, 0x00));
+		sum = _mm_add_ps(sum, _mm_mul_ps(a1, _mm_shuffle_ps(col, col, 0x55)));
+		sum = _mm_add_ps(sum, _mm_mul_ps(a2, _mm_shuffle_ps(col, col, 0xaa)));
+		sum = _mm_add_ps(sum, _mm_mul_ps(a3, _mm_shuffle_ps(col, col, 0xff)));
+		_mm_storeu_ps(r + j, sum);
+	}
+#else
+	a = a * b;
+#endif
+}
 
 
-MatrixStack::MatrixStack()
+MatrixStack::MatrixStack() :
+	depth(0)
 {
-	stack.push(glm::mat4(1.0));
+	stack[0] = glm::mat4(1.0);
 }
 
 void MatrixStack::pushMatrix()
 {
-	const glm::mat4 &top = stack.top();
-	stack.push(top);
-	assert(stack.size() < MaxMatrixSize);
+	assert(depth + 1 < MaxDepth);
+	stack[depth + 1] = stack[depth];
+	depth++;
 }
 
 void MatrixStack::popMatrix()
 {
-	assert(!stack.empty());
-	stack.pop();
-
 	// There should always be one matrix left.
-	assert(!stack.empty());
+	assert(depth > 0);
+	depth--;
 }
 
 void MatrixStack::loadIdentity()
 {
-	glm::mat4 &top = stack.top();
-	top = glm::mat4(1.f);
+	stack[depth] = glm::mat4(1.f);
 }
 
 void MatrixStack::perspective(float fovy, float aspect, float zNear, float zFar)
 {
-	glm::mat4 &top = stack.top();
-	top *= glm::perspective(fovy, aspect, zNear, zFar);
+	multiplyInPlace(stack[depth], glm::perspective(fovy, aspect, zNear, zFar));
 }
 
 void MatrixStack::translate(const glm::vec3 &offset)
 {
-	glm::mat4 &top = stack.top();
-	glm::mat4 t = glm::translate(glm::mat4(1.f), offset);
-	top *= t;
+	// Only the last column changes: it picks up the offset in the top's frame
+	glm::mat4 &top = stack[depth];
+	top[3] = top[0] * offset.x + top[1] * offset.y + top[2] * offset.z + top[3];
 }
 
 void MatrixStack::scale(const glm::vec3 &scaleV)
 {
-	glm::mat4 &top = stack.top();
-	glm::mat4 s = glm::scale(glm::mat4(1.f), scaleV);
-	top *= s;
+	glm::mat4 &top = stack[depth];
+	top[0] *= scaleV.x;
+	top[1] *= scaleV.y;
+	top[2] *= scaleV.z;
 }
 
 void MatrixStack::scale(float size)
 {
-	glm::mat4 &top = stack.top();
-	glm::mat4 s = glm::scale(glm::mat4(1.f), glm::vec3(size));
-	top *= s;
+	glm::mat4 &top = stack[depth];
+	top[0] *= size;
+	top[1] *= size;
+	top[2] *= size;
 }
 
 void MatrixStack::rotate(float angle, const glm::vec3 &axis)
 {
-	glm::mat4 &top = stack.top();
-	glm::mat4 r = glm::rotate(glm::mat4(1.0), angle, axis);
-	top *= r;
+	glm::mat4 &top = stack[depth];
+	const float c = cosf(angle);
+	const float s = sinf(angle);
+
+	// Rotations about a principal axis only mix two columns
+	if (axis.x == 0.f && axis.y == 0.f && axis.z != 0.f)
+	{
+		const float sz = axis.z > 0.f ? s : -s;
+		const glm::vec4 x = top[0];
+		top[0] = x * c + top[1] * sz;
+		top[1] = top[1] * c - x * sz;
+		return;
+	}
+	if (axis.x == 0.f && axis.z == 0.f && axis.y != 0.f)
+	{
+		const float sy = axis.y > 0.f ? s : -s;
+		const glm::vec4 x = top[0];
+		top[0] = x * c - top[2] * sy;
+		top[2] = x * sy + top[2] * c;
+		return;
+	}
+	if (axis.y == 0.f && axis.z == 0.f && axis.x != 0.f)
+	{
+		const float sx = axis.x > 0.f ? s : -s;
+		const glm::vec4 y = top[1];
+		top[1] = y * c + top[2] * sx;
+		top[2] = top[2] * c - y * sx;
+		return;
+	}
+
+	// General axis, same matrix as glm::rotate
+	const glm::vec3 a = glm::normalize(axis);
+	const glm::vec3 t = a * (1.f - c);
+	const glm::vec4 x = top[0];
+	const glm::vec4 y = top[1];
+	const glm::vec4 z = top[2];
+	top[0] = x * (c + t.x * a.x) + y * (t.x * a.y + s * a.z) + z * (t.x * a.z - s * a.y);
+	top[1] = x * (t.y * a.x - s * a.z) + y * (c + t.y * a.y) + z * (t.y * a.z + s * a.x);
+	top[2] = x * (t.z * a.x + s * a.y) + y * (t.z * a.y - s * a.x) + z * (c + t.z * a.z);
 }
 
 void MatrixStack::multMatrix(const glm::mat4 &matrix)
 {
-	glm::mat4 &top = stack.top();
-	top *= matrix;
+	multiplyInPlace(stack[depth], matrix);
 }
 
 void MatrixStack::ortho(float left, float right, float bottom, float top, float zNear, float zFar)
@@ -78,25 +163,22 @@ void MatrixStack::ortho(float left, float right, float bottom, float top, float
 	assert(bottom != top);
 	assert(zFar != zNear);
 
-	glm::mat4 &ctm = stack.top();
-	ctm *= glm::ortho(left, right, bottom, top, zNear, zFar);
+	multiplyInPlace(stack[depth], glm::ortho(left, right, bottom, top, zNear, zFar));
 }
 
 void MatrixStack::frustum(float left, float right, float bottom, float top, float zNear, float zFar)
 {
-	glm::mat4 &ctm = stack.top();
-	ctm *= glm::frustum(left, right, bottom, top, zNear, zFar);
+	multiplyInPlace(stack[depth], glm::frustum(left, right, bottom, top, zNear, zFar));
 }
 
 void MatrixStack::lookAt(const glm::vec3 &eye, const glm::vec3 &target, const glm::vec3 &up)
 {
-	glm::mat4 &top = stack.top();
-	top *= glm::lookAt(eye, target, up);
+	multiplyInPlace(stack[depth], glm::lookAt(eye, target, up));
 }
 
 const glm::mat4 &MatrixStack::topMatrix() const
 {
-	return stack.top();
+	return stack[depth];
 }
 
 void MatrixStack::print(const glm::mat4 &mat, const char *name)
@@ -124,5 +206,5 @@ void MatrixStack::print(const glm::mat4 &mat, const char *name)
 
 void MatrixStack::print(const char *name) const
 {
-	print(stack.top(), name);
+	print(stack[depth], name);
 }
@@ -3,7 +3,6 @@
 #ifndef LAB471_MATRIXSTACK_H_INCLUDED
 #define LAB471_MATRIXSTACK_H_INCLUDED
 
-#include <stack>
 #include <memory>
 
 #include "glm/glm.hpp"
@@ -12,10 +11,20 @@
 #include "glm/gtc/matrix_transform.hpp"
 
 
+// Fixed-depth stack of transforms. The matrices live inside the object, so
+// a stack never allocates, and translate/scale/rotate update the top matrix
+// in place instead of building a full matrix and multiplying by it.
 class MatrixStack
 {
 
-	std::stack<glm::mat4> stack;
+public:
+
+	static const int MaxDepth = 32;
+
+private:
+
+	alignas(16) glm::mat4 stack[MaxDepth];
+	int depth;
 
 public:
 
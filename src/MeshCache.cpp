@@ -0,0 +1,346 @@
+
+#include "MeshCache.h"
+#include "Profiler.h"
+#include "Shape.h"
+
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace
+{
+
+const char CacheMagic[4] = { 'M', 'S', 'H', 'C' };
+const uint32_t CacheVersion = 1;
+
+// All offsets are from the start of the file; every array starts on an
+// 8 byte boundary so the mapped pointers are suitably aligned.
+struct FileHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	uint32_t meshCount;
+	uint32_t reserved;
+};
+
+struct MeshEntry
+{
+	uint64_t nameOffset;
+	uint64_t positionsOffset;
+	uint64_t normalsOffset;
+	uint64_t texcoordsOffset; // 0 when there are no texcoords
+	uint64_t indicesOffset;
+	uint32_t nameLength;
+	uint32_t numVertices;
+	uint32_t numIndices;
+	uint32_t reserved;
+};
+
+size_t align8(size_t n)
+{
+	return (n + 7) & ~size_t(7);
+}
+
+size_t append(vector<char> &out, const void *data, size_t size)
+{
+	size_t offset = align8(out.size());
+	out.resize(offset + size);
+	if (size > 0)
+	{
+		memcpy(&out[offset], data, size);
+	}
+	return offset;
+}
+
+bool statFile(const string &path, uint64_t &size, int64_t &mtime)
+{
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0)
+	{
+		return false;
+	}
+	size = (uint64_t) st.st_size;
+	mtime = (int64_t) st.st_mtime;
+	return true;
+}
+
+}
+
+MeshCache::~MeshCache()
+{
+	release();
+}
+
+void MeshCache::release()
+{
+	meshes.clear();
+	buffer.clear();
+
+	if (mapping)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(mapping);
+#else
+		munmap(mapping, mappingSize);
+#endif
+		mapping = nullptr;
+		mappingSize = 0;
+	}
+}
+
+bool MeshCache::load(const string &objPath, string &err, bool parallelParse)
+{
+	PROFILE_SCOPE("MeshCache::load");
+
+	release();
+
+	uint64_t sourceSize = 0;
+	int64_t sourceTime = 0;
+	if (!statFile(objPath, sourceSize, sourceTime))
+	{
+		err = "Cannot open file [" + objPath + "]\n";
+		return false;
+	}
+
+	const string cachePath = objPath + ".mcache";
+
+	// Fast path: a cache file that matches the current source
+	if (map(cachePath))
+	{
+		if (parse((const char *) mapping, mappingSize, sourceSize, sourceTime))
+		{
+			return true;
+		}
+		release();
+	}
+
+	// Slow path: parse the OBJ and rebuild the cache
+	vector<tinyobj::shape_t> shapes;
+	vector<tinyobj::material_t> materials;
+	bool rc;
+	{
+		PROFILE_SCOPE("tinyobj::LoadObj");
+		rc = parallelParse ?
+			tinyobj::LoadObjParallel(shapes, materials, err, objPath.c_str()) :
+			tinyobj::LoadObj(shapes, materials, err, objPath.c_str());
+	}
+	if (!rc)
+	{
+		return false;
+	}
+
+	vector<char> data;
+	serialize(shapes, sourceSize, sourceTime, data);
+
+	// Write to a temporary name first so a crash never leaves a torn cache
+	const string tempPath = cachePath + ".tmp";
+	bool written = false;
+	{
+		ofstream file(tempPath, ios::binary | ios::trunc);
+		if (file)
+		{
+			file.write(data.data(), (streamsize) data.size());
+			written = (bool) file;
+		}
+	}
+	if (written)
+	{
+		remove(cachePath.c_str());
+		written = rename(tempPath.c_str(), cachePath.c_str()) == 0;
+	}
+	if (!written)
+	{
+		remove(tempPath.c_str());
+		cerr << "WARN: could not write mesh cache " << cachePath << endl;
+	}
+
+	if (written && map(cachePath) && parse((const char *) mapping, mappingSize, sourceSize, sourceTime))
+	{
+		return true;
+	}
+
+	// The resource directory may be read only; serve from memory instead
+	release();
+	buffer.swap(data);
+	return parse(buffer.data(), buffer.size(), sourceSize, sourceTime);
+}
+
+bool MeshCache::map(const string &cachePath)
+{
+#ifdef _WIN32
+	HANDLE file = CreateFileA(cachePath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE view = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if (!view)
+	{
+		return false;
+	}
+
+	mapping = MapViewOfFile(view, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(view);
+	if (!mapping)
+	{
+		return false;
+	}
+	mappingSize = (size_t) size.QuadPart;
+#else
+	int fd = open(cachePath.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		close(fd);
+		return false;
+	}
+
+	void *ptr = mmap(nullptr, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (ptr == MAP_FAILED)
+	{
+		return false;
+	}
+
+	mapping = ptr;
+	mappingSize = (size_t) st.st_size;
+#endif
+
+	return true;
+}
+
+bool MeshCache::parse(const char *data, size_t size, uint64_t sourceSize, int64_t sourceTime)
+{
+	meshes.clear();
+
+	if (size < sizeof(FileHeader))
+	{
+		return false;
+	}
+
+	FileHeader header;
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.magic, CacheMagic, sizeof(CacheMagic)) != 0 || header.version != CacheVersion)
+	{
+		return false;
+	}
+	if (header.sourceSize != sourceSize || header.sourceTime != sourceTime)
+	{
+		return false;
+	}
+	if (sizeof(FileHeader) + (uint64_t) header.meshCount * sizeof(MeshEntry) > size)
+	{
+		return false;
+	}
+
+	const MeshEntry *entries = (const MeshEntry *) (data + sizeof(FileHeader));
+	for (uint32_t i = 0; i < header.meshCount; i++)
+	{
+		const MeshEntry &entry = entries[i];
+
+		// Reject anything pointing outside the file
+		const uint64_t vertexBytes = (uint64_t) entry.numVertices * 3 * sizeof(float);
+		const uint64_t texBytes = (uint64_t) entry.numVertices * 2 * sizeof(float);
+		const uint64_t indexBytes = (uint64_t) entry.numIndices * sizeof(unsigned int);
+		if (entry.nameOffset + entry.nameLength > size ||
+			entry.positionsOffset + vertexBytes > size ||
+			entry.normalsOffset + vertexBytes > size ||
+			entry.texcoordsOffset + texBytes > size ||
+			entry.indicesOffset + indexBytes > size)
+		{
+			meshes.clear();
+			return false;
+		}
+
+		Mesh mesh;
+		mesh.name.assign(data + entry.nameOffset, entry.nameLength);
+		mesh.positions = (const float *) (data + entry.positionsOffset);
+		mesh.normals = (const float *) (data + entry.normalsOffset);
+		mesh.texcoords = entry.texcoordsOffset ? (const float *) (data + entry.texcoordsOffset) : nullptr;
+		mesh.indices = (const unsigned int *) (data + entry.indicesOffset);
+		mesh.numVertices = entry.numVertices;
+		mesh.numIndices = entry.numIndices;
+		meshes.push_back(mesh);
+	}
+
+	return true;
+}
+
+void MeshCache::serialize(vector<tinyobj::shape_t> &shapes, uint64_t sourceSize, int64_t sourceTime, vector<char> &out)
+{
+	FileHeader header;
+	memcpy(header.magic, CacheMagic, sizeof(CacheMagic));
+	header.version = CacheVersion;
+	header.sourceSize = sourceSize;
+	header.sourceTime = sourceTime;
+	header.meshCount = (uint32_t) shapes.size();
+	header.reserved = 0;
+
+	out.clear();
+	append(out, &header, sizeof(header));
+
+	// Reserve the entry table, then fill it in once the arrays are placed
+	vector<MeshEntry> entries(shapes.size());
+	const size_t tableOffset = append(out, entries.data(), entries.size() * sizeof(MeshEntry));
+
+	for (size_t i = 0; i < shapes.size(); i++)
+	{
+		tinyobj::mesh_t &mesh = shapes[i].mesh;
+		MeshEntry &entry = entries[i];
+
+		// Bake normals now so loading never has to generate them
+		if (mesh.normals.size() != mesh.positions.size())
+		{
+			Shape::generateNormals(mesh.positions, mesh.indices, mesh.normals);
+		}
+
+		const size_t numVertices = mesh.positions.size() / 3;
+		const bool hasTexcoords = mesh.texcoords.size() == 2 * numVertices && numVertices > 0;
+
+		entry.nameLength = (uint32_t) shapes[i].name.size();
+		entry.numVertices = (uint32_t) numVertices;
+		entry.numIndices = (uint32_t) mesh.indices.size();
+		entry.reserved = 0;
+		entry.nameOffset = append(out, shapes[i].name.data(), shapes[i].name.size());
+		entry.positionsOffset = append(out, mesh.positions.data(), mesh.positions.size() * sizeof(float));
+		entry.normalsOffset = append(out, mesh.normals.data(), mesh.normals.size() * sizeof(float));
+		entry.texcoordsOffset = hasTexcoords ? append(out, mesh.texcoords.data(), mesh.texcoords.size() * sizeof(float)) : 0;
+		entry.indicesOffset = append(out, mesh.indices.data(), mesh.indices.size() * sizeof(unsigned int));
+	}
+
+	if (!entries.empty())
+	{
+		memcpy(&out[tableOffset], entries.data(), entries.size() * sizeof(MeshEntry));
+	}
+}
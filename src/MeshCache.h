@@ -0,0 +1,71 @@
+
+#pragma once
+
+#ifndef LAB471_MESHCACHE_H_INCLUDED
+#define LAB471_MESHCACHE_H_INCLUDED
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include <tiny_obj_loader/tiny_obj_loader.h>
+
+
+// Binary cache for OBJ meshes.
+//
+// The first time an OBJ is loaded it is parsed with tinyobj, normals are
+// generated where the file has none, and the result is written next to the
+// source as "<file>.mcache". Later runs map that file into memory and hand
+// out pointers into it, so a Shape can be filled without any text parsing.
+// The cache is rebuilt whenever the source file's size or mtime changes.
+class MeshCache
+{
+
+public:
+
+	// A view of one shape inside the cache file. The pointers stay valid
+	// for as long as the MeshCache that produced them is alive.
+	struct Mesh
+	{
+		std::string name;
+		const float *positions = nullptr;
+		const float *normals = nullptr;
+		const float *texcoords = nullptr; // null when the OBJ had none
+		const unsigned int *indices = nullptr;
+		size_t numVertices = 0;
+		size_t numIndices = 0;
+	};
+
+	MeshCache() = default;
+	~MeshCache();
+
+	MeshCache(const MeshCache&) = delete;
+	MeshCache& operator= (const MeshCache&) = delete;
+
+	// Loads objPath through its cache file, rebuilding the cache if it is
+	// missing or stale. Returns false and fills err if the OBJ can't be read.
+	// With parallelParse a rebuild uses tinyobj::LoadObjParallel, which is
+	// worth it for large files.
+	bool load(const std::string &objPath, std::string &err, bool parallelParse = false);
+
+	// Unmaps the current file; any Mesh pointers become invalid
+	void release();
+
+	const std::vector<Mesh> &getMeshes() const { return meshes; }
+
+private:
+
+	bool map(const std::string &cachePath);
+	bool parse(const char *data, size_t size, uint64_t sourceSize, int64_t sourceTime);
+	static void serialize(std::vector<tinyobj::shape_t> &shapes, uint64_t sourceSize, int64_t sourceTime, std::vector<char> &out);
+
+	void *mapping = nullptr;
+	size_t mappingSize = 0;
+	// Used instead of a mapping when the cache file could not be written
+	std::vector<char> buffer;
+	std::vector<Mesh> meshes;
+
+};
+
+#endif // LAB471_MESHCACHE_H_INCLUDED
@@ -0,0 +1,88 @@
+
+#include "MeshPool.h"
+
+#include <cassert>
+
+using namespace std;
+using namespace glm;
+
+
+size_t MeshPool::add(const Shape &shape)
+{
+	const size_t numVertices = shape.vertexCount();
+	const size_t numIndices = shape.indexCount();
+
+	Mesh mesh;
+	mesh.count = (GLsizei) numIndices;
+	mesh.firstIndex = packed.eleBuf.size();
+	mesh.baseVertex = (GLint) (packed.posBuf.size() / 3);
+	mesh.min = shape.min;
+	mesh.max = shape.max;
+	meshes.push_back(mesh);
+
+	// The shape's data may still be in its mapped cache file
+	const float *positions = shape.streamData(VertexStream::Position);
+	const unsigned int *indices = shape.indexData();
+	packed.posBuf.insert(packed.posBuf.end(), positions, positions + 3*numVertices);
+	packed.eleBuf.insert(packed.eleBuf.end(), indices, indices + numIndices);
+
+	// Normals are generated per mesh, since indices don't cross meshes
+	const float *normals = shape.streamData(VertexStream::Normal);
+	if (!normals)
+	{
+		vector<float> generated;
+		Shape::generateNormals(positions, numVertices, indices, numIndices, generated);
+		packed.norBuf.insert(packed.norBuf.end(), generated.begin(), generated.end());
+	}
+	else
+	{
+		packed.norBuf.insert(packed.norBuf.end(), normals, normals + 3*numVertices);
+	}
+
+	// Texture coordinates are kept only if every mesh has them
+	texcoords = texcoords && shape.hasTexcoords();
+	if (texcoords)
+	{
+		const float *coords = shape.streamData(VertexStream::Texcoord);
+		packed.texBuf.insert(packed.texBuf.end(), coords, coords + 2*numVertices);
+	}
+	else
+	{
+		packed.texBuf.clear();
+	}
+
+	return meshes.size() - 1;
+}
+
+void MeshPool::init()
+{
+	if (!meshes.empty())
+	{
+		packed.init();
+	}
+
+	counts.reserve(meshes.size());
+	offsets.reserve(meshes.size());
+	baseVertices.reserve(meshes.size());
+}
+
+void MeshPool::clearDraws()
+{
+	counts.clear();
+	offsets.clear();
+	baseVertices.clear();
+}
+
+void MeshPool::addDraw(size_t mesh)
+{
+	assert(mesh < meshes.size());
+	const Mesh &m = meshes[mesh];
+	counts.push_back(m.count);
+	offsets.push_back((const void *) (m.firstIndex * sizeof(unsigned int)));
+	baseVertices.push_back(m.baseVertex);
+}
+
+void MeshPool::draw(const shared_ptr<Program> &prog) const
+{
+	packed.drawRanges(prog, counts.data(), offsets.data(), baseVertices.data(), (GLsizei) counts.size());
+}
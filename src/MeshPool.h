@@ -0,0 +1,72 @@
+
+#pragma once
+
+#ifndef LAB471_MESHPOOL_H_INCLUDED
+#define LAB471_MESHPOOL_H_INCLUDED
+
+#include <memory>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "Shape.h"
+
+class Program;
+
+
+// Static meshes packed into one shared vertex buffer and one index buffer.
+// Each mesh keeps its own indices and is located by its first index and
+// base vertex, so any subset of them is drawn with a single
+// glMultiDrawElementsBaseVertex call and a single VAO.
+class MeshPool
+{
+
+public:
+
+	// Appends shape's vertices and indices. CPU only, so a loader thread can
+	// fill the pool; returns the mesh's index.
+	size_t add(const Shape &shape);
+
+	// Uploads everything added so far. GL thread only; nothing can be added
+	// afterwards.
+	void init();
+
+	size_t size() const { return meshes.size(); }
+	const glm::vec3 & getMin(size_t mesh) const { return meshes[mesh].min; }
+	const glm::vec3 & getMax(size_t mesh) const { return meshes[mesh].max; }
+
+	// The meshes the next draw() covers, rebuilt every frame after culling
+	void clearDraws();
+	void addDraw(size_t mesh);
+	size_t numDraws() const { return counts.size(); }
+
+	// One multi-draw of every mesh added with addDraw()
+	void draw(const std::shared_ptr<Program> &prog) const;
+
+private:
+
+	struct Mesh
+	{
+		GLsizei count;
+		size_t firstIndex;
+		GLint baseVertex;
+		glm::vec3 min;
+		glm::vec3 max;
+	};
+
+	std::vector<Mesh> meshes;
+
+	// Holds the packed data and its VAOs; its indices are per mesh
+	Shape packed;
+	// Cleared as soon as one mesh comes without texture coordinates
+	bool texcoords = true;
+
+	// Arguments for the next multi-draw
+	std::vector<GLsizei> counts;
+	std::vector<const void *> offsets;
+	std::vector<GLint> baseVertices;
+
+};
+
+#endif // LAB471_MESHPOOL_H_INCLUDED
@@ -7,6 +7,7 @@
 #include "Particle.h"
 #include "GLSL.h"
 #include "MatrixStack.h"
+#include "Profiler.h"
 #include "Program.h"
 #include "Texture.h"
 
@@ -49,6 +50,8 @@ void Particle::rebirth(float t)
 
 void Particle::update(float t, float h, const vec3 &g, const bool *keyToggles)
 {
+	PROFILE_SCOPE("Particle::update");
+
 	time += 0.01;
 	if (t > tEnd)
 	{
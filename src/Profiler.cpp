@@ -0,0 +1,159 @@
+
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+
+namespace
+{
+	typedef chrono::steady_clock Clock;
+
+	// Every thread's ring, and a timestamp taken alongside the clock so
+	// timestamps can be converted to microseconds when dumping
+	struct Registry
+	{
+		mutex lock;
+		// Never freed: a thread may still be recording while the program
+		// exits
+		vector<Profiler::ThreadBuffer *> buffers;
+		uint64_t originTicks = Profiler::now();
+		Clock::time_point originTime = Clock::now();
+	};
+
+	Registry &registry()
+	{
+		static Registry *instance = new Registry();
+		return *instance;
+	}
+
+	struct TraceEvent
+	{
+		const char *name;
+		uint64_t start;
+		uint64_t end;
+		int threadId;
+	};
+
+	void writeEscaped(FILE *file, const char *text)
+	{
+		for (const char *c = text; *c; c++)
+		{
+			if (*c == '"' || *c == '\\')
+			{
+				fputc('\\', file);
+			}
+			fputc((unsigned char) *c < 0x20 ? ' ' : *c, file);
+		}
+	}
+}
+
+thread_local Profiler::ThreadBuffer *Profiler::threadBuffer = nullptr;
+
+Profiler::ThreadBuffer *Profiler::registerThread()
+{
+	ThreadBuffer *buffer = new ThreadBuffer();
+	buffer->head.store(0);
+
+	Registry &reg = registry();
+	lock_guard<mutex> lock(reg.lock);
+	buffer->threadId = (int) reg.buffers.size() + 1;
+	buffer->threadName = "thread " + to_string(buffer->threadId);
+	reg.buffers.push_back(buffer);
+	threadBuffer = buffer;
+	return buffer;
+}
+
+void Profiler::setThreadName(const string &name)
+{
+	ThreadBuffer *buffer = threadBuffer ? threadBuffer : registerThread();
+	lock_guard<mutex> lock(registry().lock);
+	buffer->threadName = name;
+}
+
+bool Profiler::writeChromeTrace(const string &path)
+{
+	Registry &reg = registry();
+	vector<TraceEvent> events;
+	vector<pair<int, string>> threads;
+	{
+		lock_guard<mutex> lock(reg.lock);
+		for (ThreadBuffer *buffer : reg.buffers)
+		{
+			threads.push_back(make_pair(buffer->threadId, buffer->threadName));
+
+			const uint64_t head = buffer->head.load(memory_order_acquire);
+			const size_t first = events.size();
+			for (uint64_t i = head > RingSize ? head - RingSize : 0; i < head; i++)
+			{
+				const ThreadBuffer::Event &event = buffer->events[i % RingSize];
+				events.push_back({ event.name.load(memory_order_relaxed), event.start.load(memory_order_relaxed),
+					event.end.load(memory_order_relaxed), buffer->threadId });
+			}
+
+			// Drop whatever the thread overwrote while it was being copied. The
+			// fence pairs with the one in record(): a copied store of a newer
+			// event guarantees the reload sees that event's head, and the slot
+			// of event after may be half written already.
+			atomic_thread_fence(memory_order_acquire);
+			const uint64_t after = buffer->head.load(memory_order_relaxed);
+			const uint64_t overwritten = after + 1 > RingSize ? after + 1 - RingSize : 0;
+			const uint64_t copiedFrom = head > RingSize ? head - RingSize : 0;
+			if (overwritten > copiedFrom)
+			{
+				const size_t drop = (size_t) min<uint64_t>(overwritten - copiedFrom, head - copiedFrom);
+				events.erase(events.begin() + first, events.begin() + first + drop);
+			}
+		}
+	}
+
+	// Timestamp ticks per microsecond, measured since the first thread
+	// registered
+	const double elapsedMicros = chrono::duration<double, micro>(Clock::now() - reg.originTime).count();
+	const uint64_t elapsedTicks = now() - reg.originTicks;
+	const double ticksPerMicro = elapsedMicros > 0.0 && elapsedTicks > 0 ? elapsedTicks / elapsedMicros : 1.0;
+
+	uint64_t origin = reg.originTicks;
+	for (const TraceEvent &event : events)
+	{
+		origin = min(origin, event.start);
+	}
+
+	FILE *file = fopen(path.c_str(), "w");
+	if (!file)
+	{
+		cerr << "failed to write: " << path << endl;
+		return false;
+	}
+
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	bool first = true;
+	for (const pair<int, string> &thread : threads)
+	{
+		fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"", first ? "" : ",\n", thread.first);
+		writeEscaped(file, thread.second.c_str());
+		fprintf(file, "\"}}");
+		first = false;
+	}
+	for (const TraceEvent &event : events)
+	{
+		fprintf(file, "%s{\"name\":\"", first ? "" : ",\n");
+		writeEscaped(file, event.name);
+		fprintf(file, "\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", event.threadId,
+			(event.start - origin) / ticksPerMicro, (event.end - event.start) / ticksPerMicro);
+		first = false;
+	}
+	fprintf(file, "\n]}\n");
+
+	const bool ok = fclose(file) == 0;
+	if (ok)
+	{
+		cout << "Wrote " << events.size() << " profile scopes to " << path << endl;
+	}
+	return ok;
+}
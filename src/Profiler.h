@@ -0,0 +1,121 @@
+
+#pragma once
+
+#ifndef LAB471_PROFILER_H_INCLUDED
+#define LAB471_PROFILER_H_INCLUDED
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define LAB471_PROFILER_TSC
+#endif
+
+
+// Scoped CPU timing for finding startup and frame spikes. Built with
+// LAB471_PROFILE defined (cmake -DLAB471_PROFILE=ON),
+//
+//   PROFILE_SCOPE("Shape::draw");
+//
+// records the time from there to the end of the enclosing block into a
+// ring buffer owned by the calling thread: two timestamp reads and a few
+// stores, no locks. Without LAB471_PROFILE the macros expand to nothing.
+//
+// writeChromeTrace() dumps every thread's ring as Chrome trace_event JSON,
+// which Perfetto (ui.perfetto.dev) and chrome://tracing open. Each ring
+// keeps the latest RingSize scopes of its thread.
+namespace Profiler
+{
+	static const uint64_t RingSize = 1 << 15;
+
+	// Raw timestamp: the TSC where there is one, steady_clock otherwise
+	inline uint64_t now()
+	{
+#ifdef LAB471_PROFILER_TSC
+		return __rdtsc();
+#else
+		return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+	}
+
+	// Written only by its thread. Every field is atomic so a dump from
+	// another thread may read the ring while it is being written; entries
+	// overwritten during the dump are dropped.
+	struct ThreadBuffer
+	{
+		struct Event
+		{
+			std::atomic<const char *> name;
+			std::atomic<uint64_t> start;
+			std::atomic<uint64_t> end;
+		};
+
+		Event events[RingSize];
+		// Events ever recorded; the next one goes to head % RingSize
+		std::atomic<uint64_t> head;
+		int threadId;
+		std::string threadName;
+	};
+
+	// The calling thread's ring, registered on first use
+	extern thread_local ThreadBuffer *threadBuffer;
+	ThreadBuffer *registerThread();
+
+	// name must outlive the profiler; string literals do
+	inline void record(const char *name, uint64_t start, uint64_t end)
+	{
+		ThreadBuffer *buffer = threadBuffer ? threadBuffer : registerThread();
+		const uint64_t head = buffer->head.load(std::memory_order_relaxed);
+		ThreadBuffer::Event &event = buffer->events[head % RingSize];
+		// A dump that sees any of the stores below also sees head, so it
+		// knows this slot is being rewritten (the writer half of a seqlock;
+		// free on x86)
+		std::atomic_thread_fence(std::memory_order_release);
+		event.name.store(name, std::memory_order_relaxed);
+		event.start.store(start, std::memory_order_relaxed);
+		event.end.store(end, std::memory_order_relaxed);
+		buffer->head.store(head + 1, std::memory_order_release);
+	}
+
+	// Shown for the calling thread in the trace
+	void setThreadName(const std::string &name);
+
+	bool writeChromeTrace(const std::string &path);
+
+	class Scope
+	{
+
+	public:
+
+		explicit Scope(const char *name) : name(name), start(now()) {}
+		~Scope() { record(name, start, now()); }
+
+		Scope(const Scope&) = delete;
+		Scope& operator= (const Scope&) = delete;
+
+	private:
+
+		const char *name;
+		uint64_t start;
+
+	};
+}
+
+#ifdef LAB471_PROFILE
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#define PROFILE_SCOPE(name) Profiler::Scope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_THREAD(name) Profiler::setThreadName(name)
+#else
+#define PROFILE_SCOPE(name) do {} while (0)
+#define PROFILE_THREAD(name) do {} while (0)
+#endif
+
+#endif // LAB471_PROFILER_H_INCLUDED
@@ -5,8 +5,19 @@
 #include <fstream>
 
 #include "GLSL.h"
+#include "GLState.h"
+#include "CameraBuffer.h"
+#include "Profiler.h"
+#include "ProgramCache.h"
 
 
+const char * const UniformNames[(int) Uniform::Count] =
+{
+#define LAB471_UNIFORM_NAME(name) #name,
+	LAB471_UNIFORM_LIST(LAB471_UNIFORM_NAME)
+#undef LAB471_UNIFORM_NAME
+};
+
 std::string readFileAsString(const std::string &fileName)
 {
 	std::string result;
@@ -35,6 +46,43 @@ void Program::setShaderNames(const std::string &v, const std::string &f)
 }
 
 bool Program::init()
+{
+	PROFILE_SCOPE("Program::init");
+
+	// Read shader sources
+	std::string vShaderString = readFileAsString(vShaderName);
+	std::string fShaderString = readFileAsString(fShaderName);
+
+	// A cached binary of the same sources skips compiling and linking
+	const std::string cachePath = ProgramCache::pathFor(vShaderName, fShaderName);
+	const uint64_t cacheKey = ProgramCache::keyFor(vShaderString, fShaderString);
+	pid = glCreateProgram();
+	if (!ProgramCache::load(cachePath, cacheKey, pid))
+	{
+		// Start over in case the driver was handed a binary and refused it
+		glDeleteProgram(pid);
+		pid = glCreateProgram();
+		if (!compileAndLink(vShaderString, fShaderString))
+		{
+			return false;
+		}
+		ProgramCache::store(cachePath, cacheKey, pid);
+	}
+
+	resolveVertexLocations();
+	reflectUniforms();
+
+	// Shared uniform blocks live at fixed binding points
+	GLuint cameraBlock = glGetUniformBlockIndex(pid, CameraBlockName);
+	if (cameraBlock != GL_INVALID_INDEX)
+	{
+		CHECKED_GL_CALL(glUniformBlockBinding(pid, cameraBlock, CameraBlockBinding));
+	}
+
+	return true;
+}
+
+bool Program::compileAndLink(const std::string &vShaderString, const std::string &fShaderString)
 {
 	GLint rc;
 
@@ -42,9 +90,6 @@ bool Program::init()
 	GLuint VS = glCreateShader(GL_VERTEX_SHADER);
 	GLuint FS = glCreateShader(GL_FRAGMENT_SHADER);
 
-	// Read shader sources
-	std::string vShaderString = readFileAsString(vShaderName);
-	std::string fShaderString = readFileAsString(fShaderName);
 	const char *vshader = vShaderString.c_str();
 	const char *fshader = fShaderString.c_str();
 	CHECKED_GL_CALL(glShaderSource(VS, 1, &vshader, NULL));
@@ -76,10 +121,16 @@ bool Program::init()
 		return false;
 	}
 
-	// Create the program and link
-	pid = glCreateProgram();
+	// Link into the program
 	CHECKED_GL_CALL(glAttachShader(pid, VS));
 	CHECKED_GL_CALL(glAttachShader(pid, FS));
+	// Pin the standard vertex attributes to their fixed locations; an
+	// explicit layout(location) in the shader takes precedence over this
+	for (int i = 0; i < NumVertexSlots; i++)
+	{
+		CHECKED_GL_CALL(glBindAttribLocation(pid, VertexSlotLocations[i], VertexSlotNames[i]));
+	}
+	ProgramCache::prepare(pid);
 	CHECKED_GL_CALL(glLinkProgram(pid));
 	CHECKED_GL_CALL(glGetProgramiv(pid, GL_LINK_STATUS, &rc));
 	if (!rc)
@@ -95,14 +146,90 @@ bool Program::init()
 	return true;
 }
 
+// Registers every active uniform, so addUniform() is no longer required, and
+// points the Uniform slots at their locations
+void Program::reflectUniforms()
+{
+	uniforms.clear();
+	uniformLocations.clear();
+	for (UniformSlot &slot : uniformSlots)
+	{
+		slot = UniformSlot();
+	}
+
+	GLint count = 0;
+	GLint maxLength = 0;
+	CHECKED_GL_CALL(glGetProgramiv(pid, GL_ACTIVE_UNIFORMS, &count));
+	CHECKED_GL_CALL(glGetProgramiv(pid, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength));
+	std::vector<char> nameBuffer(maxLength + 1);
+
+	for (GLint i = 0; i < count; i++)
+	{
+		GLsizei length = 0;
+		GLint size = 0;
+		GLenum type = 0;
+		CHECKED_GL_CALL(glGetActiveUniform(pid, i, (GLsizei) nameBuffer.size(), &length, &size, &type, nameBuffer.data()));
+		std::string name(nameBuffer.data(), length);
+
+		// Arrays are reported once, as "name[0]" with their length in size
+		const bool isArray = name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0;
+		if (isArray)
+		{
+			name.erase(name.size() - 3);
+		}
+
+		const int first = (int) uniformLocations.size();
+		for (GLint e = 0; e < size; e++)
+		{
+			const std::string element = isArray ? name + "[" + std::to_string(e) + "]" : name;
+			GLint location = glGetUniformLocation(pid, element.c_str());
+			uniformLocations.push_back(location);
+			uniforms[element] = location;
+		}
+		if (isArray)
+		{
+			uniforms[name] = uniformLocations[first];
+		}
+
+		for (int slot = 0; slot < (int) Uniform::Count; slot++)
+		{
+			if (name == UniformNames[slot])
+			{
+				uniformSlots[slot].first = first;
+				uniformSlots[slot].count = size;
+				break;
+			}
+		}
+	}
+}
+
+void Program::resolveVertexLocations()
+{
+	for (int i = 0; i < NumVertexSlots; i++)
+	{
+		GLint location = glGetAttribLocation(pid, VertexSlotNames[i]);
+		if (location == -1)
+		{
+			location = VertexSlotLocations[i];
+		}
+		else if (location != VertexSlotLocations[i] && isVerbose())
+		{
+			std::cout << "WARN: " << VertexSlotNames[i] << " is at location " << location << " in " << vShaderName
+				<< " instead of " << VertexSlotLocations[i] << "; shapes will need a separate VAO for it" << std::endl;
+		}
+		vertexLocations[i] = location;
+	}
+	vertexLayout = vertexLayoutKey(vertexLocations);
+}
+
 void Program::bind()
 {
-	CHECKED_GL_CALL(glUseProgram(pid));
+	GLState::useProgram(pid);
 }
 
 void Program::unbind()
 {
-	CHECKED_GL_CALL(glUseProgram(0));
+	GLState::useProgram(0);
 }
 
 void Program::addAttribute(const std::string &name)
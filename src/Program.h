@@ -6,9 +6,13 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
 #include <glad/glad.h>
 
+#include "Uniforms.h"
+#include "VertexFormat.h"
+
 
 std::string readFileAsString(const std::string &fileName);
 
@@ -30,6 +34,20 @@ public:
 	GLint getAttribute(const std::string &name) const;
 	GLint getUniform(const std::string &name) const;
 
+	// Location of a uniform slot (or element index of an array uniform), -1
+	// if the program doesn't use it. Resolved at link time; no lookups.
+	GLint getUniform(Uniform slot, int index = 0) const
+	{
+		const UniformSlot &s = uniformSlots[(int) slot];
+		return index < s.count ? uniformLocations[s.first + index] : -1;
+	}
+
+	// Where each vertex slot landed after linking. Slots the shaders don't
+	// use report their standard location, since enabling them is harmless.
+	GLint getVertexLocation(int slot) const { return vertexLocations[slot]; }
+	// Equal for programs whose attributes share locations, and thus VAOs
+	unsigned int getVertexLayout() const { return vertexLayout; }
+
 protected:
 
 	std::string vShaderName;
@@ -42,6 +60,25 @@ private:
 	std::map<std::string, GLint> uniforms;
 	bool verbose = true;
 
+	// Where each Uniform slot's locations start in uniformLocations
+	struct UniformSlot
+	{
+		int first = 0;
+		int count = 0;
+	};
+	UniformSlot uniformSlots[(int) Uniform::Count];
+	// Every active uniform location, array elements contiguous
+	std::vector<GLint> uniformLocations;
+
+	bool compileAndLink(const std::string &vShaderString, const std::string &fShaderString);
+
+	void reflectUniforms();
+
+	GLint vertexLocations[NumVertexSlots] = { 0, 1, 2, 3 };
+	unsigned int vertexLayout = 0;
+
+	void resolveVertexLocations();
+
 };
 
 #endif // LAB471_PROGRAM_H_INCLUDED
@@ -0,0 +1,250 @@
+
+#include "ProgramCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include <GLFW/glfw3.h>
+
+#include "GLSL.h"
+#include "VertexFormat.h"
+
+using namespace std;
+
+
+// From GL 4.1 / ARB_get_program_binary
+#define LAB471_GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define LAB471_GL_PROGRAM_BINARY_LENGTH 0x8741
+#define LAB471_GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+
+namespace ProgramCache
+{
+
+	typedef void (APIENTRY *GetProgramBinaryProc)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+	typedef void (APIENTRY *ProgramBinaryProc)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+	typedef void (APIENTRY *ProgramParameteriProc)(GLuint program, GLenum pname, GLint value);
+
+	static GetProgramBinaryProc getProgramBinary = nullptr;
+	static ProgramBinaryProc programBinary = nullptr;
+	static ProgramParameteriProc programParameteri = nullptr;
+
+	static bool enabled = true;
+	// Whether the driver has been asked yet, and what it said
+	static bool probed = false;
+	static bool supported = false;
+
+	// "L471PRG" and a format version
+	static const char Magic[8] = { 'L', '4', '7', '1', 'P', 'R', 'G', '1' };
+
+	struct Header
+	{
+		char magic[8];
+		uint64_t key;
+		uint32_t binaryFormat;
+		uint32_t length;
+	};
+
+	static bool hasExtension(const char *name)
+	{
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		for (GLint i = 0; i < count; i++)
+		{
+			const char *extension = (const char *) glGetStringi(GL_EXTENSIONS, i);
+			if (extension && strcmp(extension, name) == 0)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	static void probe()
+	{
+		probed = true;
+		if (GLVersion.major < 4 || (GLVersion.major == 4 && GLVersion.minor < 1))
+		{
+			if (!hasExtension("GL_ARB_get_program_binary"))
+			{
+				return;
+			}
+		}
+
+		getProgramBinary = (GetProgramBinaryProc) glfwGetProcAddress("glGetProgramBinary");
+		programBinary = (ProgramBinaryProc) glfwGetProcAddress("glProgramBinary");
+		programParameteri = (ProgramParameteriProc) glfwGetProcAddress("glProgramParameteri");
+		if (!getProgramBinary || !programBinary || !programParameteri)
+		{
+			return;
+		}
+
+		// Some drivers expose the calls but support no formats
+		GLint formats = 0;
+		glGetIntegerv(LAB471_GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		supported = formats > 0;
+	}
+
+	void setEnabled(bool enabled)
+	{
+		ProgramCache::enabled = enabled;
+	}
+
+	bool available()
+	{
+		if (!enabled)
+		{
+			return false;
+		}
+		if (!probed)
+		{
+			probe();
+		}
+		return supported;
+	}
+
+	string pathFor(const string &vertexShader, const string &fragmentShader)
+	{
+		const size_t slash = fragmentShader.find_last_of("/\\");
+		const string fragmentName = slash == string::npos ? fragmentShader : fragmentShader.substr(slash + 1);
+		return vertexShader + "." + fragmentName + ".pcache";
+	}
+
+	// FNV-1a, with each string's length folded in so fields can't run
+	// together
+	static void hash(uint64_t &h, const void *data, size_t size)
+	{
+		const unsigned char *bytes = (const unsigned char *) data;
+		for (size_t i = 0; i < size; i++)
+		{
+			h = (h ^ bytes[i]) * 0x100000001b3ull;
+		}
+	}
+
+	static void hashString(uint64_t &h, const char *text)
+	{
+		const uint64_t length = text ? strlen(text) : 0;
+		hash(h, &length, sizeof(length));
+		hash(h, text, length);
+	}
+
+	uint64_t keyFor(const string &vertexSource, const string &fragmentSource)
+	{
+		uint64_t h = 0xcbf29ce484222325ull;
+		hashString(h, vertexSource.c_str());
+		hashString(h, fragmentSource.c_str());
+		hashString(h, (const char *) glGetString(GL_VENDOR));
+		hashString(h, (const char *) glGetString(GL_RENDERER));
+		hashString(h, (const char *) glGetString(GL_VERSION));
+
+		// Attribute locations are bound before linking, so they are part of
+		// the binary
+		for (int i = 0; i < NumVertexSlots; i++)
+		{
+			hashString(h, VertexSlotNames[i]);
+			hash(h, &VertexSlotLocations[i], sizeof(VertexSlotLocations[i]));
+		}
+		return h;
+	}
+
+	bool load(const string &path, uint64_t key, GLuint program)
+	{
+		if (!available())
+		{
+			return false;
+		}
+
+		ifstream file(path, ios::binary);
+		Header header;
+		if (!file.read((char *) &header, sizeof(header)) || memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.key != key)
+		{
+			return false;
+		}
+		// The rest of the file must hold exactly the binary; a corrupt length
+		// mustn't turn into a huge allocation
+		const streamoff start = file.tellg();
+		file.seekg(0, ios::end);
+		const streamoff remaining = file.tellg() - start;
+		if (start < 0 || remaining != (streamoff) header.length)
+		{
+			return false;
+		}
+		file.seekg(start);
+		vector<char> binary(header.length);
+		if (!file.read(binary.data(), binary.size()))
+		{
+			return false;
+		}
+
+		// A driver may refuse a binary it wrote itself, e.g. after an update
+		// that kept the version string
+		CHECKED_GL_CALL(programBinary(program, header.binaryFormat, binary.data(), (GLsizei) binary.size()));
+		GLint linked = 0;
+		CHECKED_GL_CALL(glGetProgramiv(program, GL_LINK_STATUS, &linked));
+		return linked != 0;
+	}
+
+	void prepare(GLuint program)
+	{
+		if (available())
+		{
+			CHECKED_GL_CALL(programParameteri(program, LAB471_GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+		}
+	}
+
+	bool store(const string &path, uint64_t key, GLuint program)
+	{
+		if (!available())
+		{
+			return false;
+		}
+
+		GLint length = 0;
+		CHECKED_GL_CALL(glGetProgramiv(program, LAB471_GL_PROGRAM_BINARY_LENGTH, &length));
+		if (length <= 0)
+		{
+			return false;
+		}
+
+		Header header;
+		memcpy(header.magic, Magic, sizeof(Magic));
+		header.key = key;
+		GLenum binaryFormat = 0;
+		vector<char> binary(length);
+		GLsizei written = 0;
+		CHECKED_GL_CALL(getProgramBinary(program, length, &written, &binaryFormat, binary.data()));
+		if (written <= 0)
+		{
+			return false;
+		}
+		header.binaryFormat = binaryFormat;
+		header.length = (uint32_t) written;
+
+		// Write to a temporary name first so a crash never leaves a torn cache
+		const string tempPath = path + ".tmp";
+		bool ok = false;
+		{
+			ofstream file(tempPath, ios::binary | ios::trunc);
+			if (file)
+			{
+				file.write((const char *) &header, sizeof(header));
+				file.write(binary.data(), written);
+				ok = (bool) file;
+			}
+		}
+		if (ok)
+		{
+			remove(path.c_str());
+			ok = rename(tempPath.c_str(), path.c_str()) == 0;
+		}
+		if (!ok)
+		{
+			remove(tempPath.c_str());
+			cerr << "WARN: could not write program cache " << path << endl;
+		}
+		return ok;
+	}
+
+}
@@ -0,0 +1,46 @@
+
+#pragma once
+
+#ifndef LAB471_PROGRAMCACHE_H_INCLUDED
+#define LAB471_PROGRAMCACHE_H_INCLUDED
+
+#include <cstdint>
+#include <string>
+
+#include <glad/glad.h>
+
+
+// On-disk cache of linked programs, so later runs skip GLSL compilation.
+//
+// A program is saved with glGetProgramBinary next to its vertex shader as
+// "<vertex>.<fragment>.pcache", under a key hashed from both sources and
+// the driver's vendor, renderer and version strings. Editing a shader or
+// updating the driver changes the key and the file is rebuilt. Program
+// binaries need GL 4.1 or ARB_get_program_binary, which the 3.3 loader
+// doesn't cover, so the entry points are looked up here; without them, or
+// when the driver rejects a binary, programs are compiled as usual.
+// GL thread only.
+namespace ProgramCache
+{
+
+	// On by default; off compiles every program
+	void setEnabled(bool enabled);
+	// Enabled, and the driver can save binaries in at least one format
+	bool available();
+
+	std::string pathFor(const std::string &vertexShader, const std::string &fragmentShader);
+	uint64_t keyFor(const std::string &vertexSource, const std::string &fragmentSource);
+
+	// Links program from the cache file at path if it holds key. False if
+	// it doesn't or the driver refuses it; program is then still unlinked
+	// and can be built from source.
+	bool load(const std::string &path, uint64_t key, GLuint program);
+
+	// Asks the driver to keep program's binary; call before linking
+	void prepare(GLuint program);
+	// Saves a linked program under key
+	bool store(const std::string &path, uint64_t key, GLuint program);
+
+}
+
+#endif // LAB471_PROGRAMCACHE_H_INCLUDED
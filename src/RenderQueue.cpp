@@ -0,0 +1,242 @@
+
+#include "RenderQueue.h"
+
+#include <cstring>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "GLSL.h"
+#include "GLState.h"
+#include "GpuProfiler.h"
+#include "MeshPool.h"
+#include "Program.h"
+#include "RenderStats.h"
+#include "Shape.h"
+
+using namespace std;
+using namespace glm;
+
+
+// Field widths of the sort key, from the top
+static const int LayerBits = 4;
+static const int ProgramBits = 8;
+static const int TextureBits = 12;
+static const int MaterialBits = 8;
+static const int MeshBits = 12;
+static const int DepthBits = 20;
+
+static const int DepthShift = 0;
+static const int MeshShift = DepthShift + DepthBits;
+static const int MaterialShift = MeshShift + MeshBits;
+static const int TextureShift = MaterialShift + MaterialBits;
+static const int ProgramShift = TextureShift + TextureBits;
+static const int LayerShift = ProgramShift + ProgramBits;
+
+
+void RenderQueue::begin(const vec3 &eye)
+{
+	this->eye = eye;
+	pass = -1;
+	items.clear();
+	keys.clear();
+}
+
+uint64_t RenderQueue::idOf(vector<uintptr_t> &ids, uintptr_t object, int bits)
+{
+	for (size_t i = 0; i < ids.size(); i++)
+	{
+		if (ids[i] == object)
+		{
+			return i;
+		}
+	}
+
+	// Past the field's range everything shares the last id, which only
+	// costs sort quality; execute() compares the real state
+	const uint64_t limit = (uint64_t) 1 << bits;
+	if (ids.size() + 1 >= limit)
+	{
+		return limit - 1;
+	}
+	ids.push_back(object);
+	return ids.size() - 1;
+}
+
+void RenderQueue::submit(Layer layer, const shared_ptr<Program> &program, const TextureBinding *texture,
+	const Material *material, const Shape *shape, const mat4 &M, bool instanced)
+{
+	Item item;
+	item.program = program;
+	item.texture = texture ? *texture : TextureBinding{ GL_TEXTURE_2D, 0, 0, Uniform::Texture0 };
+	item.material = material;
+	item.shape = shape;
+	item.pool = nullptr;
+	item.M = M;
+	item.instanced = instanced;
+	push(layer, item, shape);
+}
+
+void RenderQueue::submit(Layer layer, const shared_ptr<Program> &program, const TextureBinding *texture,
+	const Material *material, const MeshPool *pool, const mat4 &M)
+{
+	Item item;
+	item.program = program;
+	item.texture = texture ? *texture : TextureBinding{ GL_TEXTURE_2D, 0, 0, Uniform::Texture0 };
+	item.material = material;
+	item.shape = nullptr;
+	item.pool = pool;
+	item.M = M;
+	item.instanced = false;
+	push(layer, item, pool);
+}
+
+void RenderQueue::push(Layer layer, const Item &item, const void *mesh)
+{
+	items.push_back(item);
+	items.back().pass = pass;
+
+	// Non-negative floats sort like their bit patterns, so the top bits of
+	// the distance make a logarithmic depth that needs no far plane
+	const mat4 &M = item.M;
+	const vec3 offset = vec3(M[3].x, M[3].y, M[3].z) - eye;
+	const float distance = sqrt(dot(offset, offset));
+	uint32_t bits;
+	memcpy(&bits, &distance, sizeof(bits));
+	const uint64_t depth = (bits >> (32 - 1 - DepthBits)) & (((uint64_t) 1 << DepthBits) - 1);
+
+	uint64_t key = (uint64_t) layer << LayerShift;
+	key |= idOf(programIds, (uintptr_t) item.program.get(), ProgramBits) << ProgramShift;
+	key |= idOf(textureIds, item.texture.id, TextureBits) << TextureShift;
+	key |= idOf(materialIds, (uintptr_t) item.material, MaterialBits) << MaterialShift;
+	key |= idOf(meshIds, (uintptr_t) mesh, MeshBits) << MeshShift;
+	key |= depth << DepthShift;
+	keys.push_back(key);
+}
+
+// LSD radix sort of keys, carrying order along, a byte at a time. Bytes
+// where every key agrees are skipped, which for a typical frame is most.
+void RenderQueue::sort()
+{
+	const size_t n = keys.size();
+	order.resize(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		order[i] = (uint32_t) i;
+	}
+	if (n < 2)
+	{
+		return;
+	}
+
+	keysScratch.resize(n);
+	orderScratch.resize(n);
+
+	for (int shift = 0; shift < 64; shift += 8)
+	{
+		size_t counts[256] = {};
+		for (size_t i = 0; i < n; i++)
+		{
+			counts[(keys[i] >> shift) & 0xff]++;
+		}
+		if (counts[(keys[0] >> shift) & 0xff] == n)
+		{
+			continue;
+		}
+
+		size_t start = 0;
+		for (int b = 0; b < 256; b++)
+		{
+			const size_t count = counts[b];
+			counts[b] = start;
+			start += count;
+		}
+		for (size_t i = 0; i < n; i++)
+		{
+			const size_t dst = counts[(keys[i] >> shift) & 0xff]++;
+			keysScratch[dst] = keys[i];
+			orderScratch[dst] = order[i];
+		}
+		keys.swap(keysScratch);
+		order.swap(orderScratch);
+	}
+}
+
+void RenderQueue::execute()
+{
+	GLSL::DebugGroup group("RenderQueue::execute");
+	sort();
+
+	// Bindings are filtered by GLState; uniforms are tracked here, since
+	// their values belong to the program
+	int layer = -1;
+	Program *program = nullptr;
+	const Material *material = nullptr;
+	Uniform sampler = Uniform::Count;
+	GLint samplerUnit = -1;
+	int timedPass = -1;
+
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		const Item &item = items[order[i]];
+
+		if (profiler && item.pass >= 0 && item.pass != timedPass)
+		{
+			timedPass = item.pass;
+			profiler->begin(timedPass);
+		}
+
+		const int itemLayer = (int) (keys[i] >> LayerShift);
+		if (itemLayer != layer)
+		{
+			layer = itemLayer;
+			GLState::depthFunc(layer == Sky ? GL_LEQUAL : GL_LESS);
+		}
+
+		// A new program needs its sampler and material set again
+		const bool programChanged = item.program.get() != program;
+		if (programChanged)
+		{
+			program = item.program.get();
+			program->bind();
+			material = nullptr;
+		}
+
+		const TextureBinding &texture = item.texture;
+		if (texture.id)
+		{
+			GLState::bindTexture(texture.unit, texture.target, texture.id);
+			if (programChanged || texture.sampler != sampler || texture.unit != samplerUnit)
+			{
+				sampler = texture.sampler;
+				samplerUnit = texture.unit;
+				CHECKED_GL_CALL(glUniform1i(program->getUniform(sampler), samplerUnit));
+				RenderStats::count(RenderStats::UniformUploads);
+			}
+		}
+
+		if (item.material && item.material != material)
+		{
+			material = item.material;
+			CHECKED_GL_CALL(glUniform3fv(program->getUniform(Uniform::MatAmb), 1, value_ptr(material->ambient)));
+			CHECKED_GL_CALL(glUniform3fv(program->getUniform(Uniform::MatDif), 1, value_ptr(material->diffuse)));
+			CHECKED_GL_CALL(glUniform3fv(program->getUniform(Uniform::MatSpec), 1, value_ptr(material->specular)));
+			CHECKED_GL_CALL(glUniform1f(program->getUniform(Uniform::shine), material->shine));
+			RenderStats::count(RenderStats::UniformUploads, 4);
+		}
+
+		CHECKED_GL_CALL(glUniformMatrix4fv(program->getUniform(Uniform::M), 1, GL_FALSE, value_ptr(item.M)));
+		RenderStats::count(RenderStats::UniformUploads);
+		if (item.pool)
+		{
+			item.pool->draw(item.program);
+		}
+		else if (item.instanced)
+		{
+			item.shape->drawInstanced(item.program);
+		}
+		else
+		{
+			item.shape->draw(item.program);
+		}
+	}
+}
@@ -0,0 +1,128 @@
+
+#pragma once
+
+#ifndef LAB471_RENDERQUEUE_H_INCLUDED
+#define LAB471_RENDERQUEUE_H_INCLUDED
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "Uniforms.h"
+
+class GpuProfiler;
+class MeshPool;
+class Program;
+class Shape;
+
+
+// Surface colors for the lit (simple_frag) shaders
+struct Material
+{
+	glm::vec3 ambient;
+	glm::vec3 diffuse;
+	glm::vec3 specular;
+	float shine;
+};
+
+// A texture and the unit and sampler uniform it is read through
+struct TextureBinding
+{
+	GLenum target;
+	GLuint id;
+	GLint unit;
+	Uniform sampler;
+};
+
+// Collects a frame's draws, sorts them by state and issues them with as few
+// state changes as possible.
+//
+// Every draw gets a 64-bit key, most significant field first:
+//
+//   layer (4) | program (8) | texture (12) | material (8) | mesh (12) | depth (20)
+//
+// so sorting groups draws by layer, then by program, and so on, and draws
+// with identical state end up front to back. execute() only touches GL
+// state where consecutive draws differ. Program, texture, material and mesh
+// ids are handed out on first use and stay the same from frame to frame.
+class RenderQueue
+{
+
+public:
+
+	// Drawn in this order, each with its own fixed state
+	enum Layer
+	{
+		Sky, // depth test GL_LEQUAL, so the box at the far plane still passes
+		Opaque, // depth test GL_LESS
+		NumLayers
+	};
+
+	// Forgets last frame's draws; depths are measured from eye
+	void begin(const glm::vec3 &eye);
+
+	// Draws submitted after this are timed as profiler pass pass. Sorting
+	// can interleave passes; execute() starts a pass's timer wherever the
+	// pass changes. -1 times draws with whatever pass came before.
+	void setPass(int pass) { this->pass = pass; }
+	void setProfiler(GpuProfiler *profiler) { this->profiler = profiler; }
+
+	// Queues shape drawn by program with the model matrix M. texture and
+	// material may be null when the program doesn't use them.
+	void submit(Layer layer, const std::shared_ptr<Program> &program, const TextureBinding *texture,
+		const Material *material, const Shape *shape, const glm::mat4 &M, bool instanced = false);
+
+	// Queues one multi-draw of the meshes pool has been told to draw. The
+	// pool's draw list is read by execute(), so it holds one group a frame.
+	void submit(Layer layer, const std::shared_ptr<Program> &program, const TextureBinding *texture,
+		const Material *material, const MeshPool *pool, const glm::mat4 &M);
+
+	// Sorts and draws everything submitted since begin(). The last program
+	// stays bound, so next frame's first bind is usually filtered out.
+	void execute();
+
+	size_t size() const { return items.size(); }
+
+private:
+
+	struct Item
+	{
+		std::shared_ptr<Program> program;
+		TextureBinding texture;
+		const Material *material;
+		const Shape *shape;
+		const MeshPool *pool;
+		glm::mat4 M;
+		bool instanced;
+		int pass;
+	};
+
+	void push(Layer layer, const Item &item, const void *mesh);
+
+	static uint64_t idOf(std::vector<uintptr_t> &ids, uintptr_t object, int bits);
+	void sort();
+
+	glm::vec3 eye = glm::vec3(0);
+	int pass = -1;
+	GpuProfiler *profiler = nullptr;
+
+	std::vector<Item> items;
+
+	// Sort keys and the items they belong to, sorted together
+	std::vector<uint64_t> keys;
+	std::vector<uint32_t> order;
+	std::vector<uint64_t> keysScratch;
+	std::vector<uint32_t> orderScratch;
+
+	// Objects that have been given key ids, indexed by id
+	std::vector<uintptr_t> programIds;
+	std::vector<uintptr_t> textureIds;
+	std::vector<uintptr_t> materialIds;
+	std::vector<uintptr_t> meshIds;
+
+};
+
+#endif // LAB471_RENDERQUEUE_H_INCLUDED
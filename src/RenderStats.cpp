@@ -0,0 +1,67 @@
+
+#include "RenderStats.h"
+
+
+namespace RenderStats
+{
+
+	static Counters frame;
+	static Counters last;
+
+	static const char * const Names[NumCounters] = {
+		"drawCalls",
+		"triangles",
+		"vertices",
+		"programBinds",
+		"textureBinds",
+		"uniformUploads",
+		"bufferBytes",
+		"stateCallsIssued",
+		"stateCallsFiltered",
+		"heapAllocations"
+	};
+
+	const char * name(Counter counter)
+	{
+		return Names[counter];
+	}
+
+	void count(Counter counter, uint64_t amount)
+	{
+		frame.values[counter] += amount;
+	}
+
+	void countDraw(uint64_t indices, uint64_t instances)
+	{
+		frame.values[DrawCalls]++;
+		frame.values[Triangles] += indices / 3 * instances;
+		frame.values[Vertices] += indices * instances;
+	}
+
+	const Counters & current()
+	{
+		return frame;
+	}
+
+	const Counters & lastFrame()
+	{
+		return last;
+	}
+
+	void endFrame()
+	{
+		last = frame;
+		frame = Counters();
+	}
+
+	void print(std::ostream &out, const Counters &counters)
+	{
+		out << "Frame stats:";
+		for (int i = 0; i < NumCounters; i++)
+		{
+			out << (i ? ", " : " ") << Names[i] << " " << counters.values[i];
+		}
+		out << std::endl;
+	}
+
+}
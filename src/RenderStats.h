@@ -0,0 +1,61 @@
+
+#pragma once
+
+#ifndef LAB471_RENDERSTATS_H_INCLUDED
+#define LAB471_RENDERSTATS_H_INCLUDED
+
+#include <cstdint>
+#include <ostream>
+
+
+// Per-frame counts of the work handed to the driver. The GL wrappers count
+// as they issue calls (binds only when GLState lets them through), main
+// closes each frame with endFrame(), and lastFrame() holds the totals of
+// the last complete frame. GL thread only.
+namespace RenderStats
+{
+
+	enum Counter
+	{
+		DrawCalls,
+		Triangles,
+		// Indices drawn, times instances: vertex shader invocations before
+		// post-transform caching
+		Vertices,
+		ProgramBinds,
+		TextureBinds,
+		UniformUploads,
+		BufferBytes,
+		// GLState calls passed to GL and dropped as redundant
+		StateCallsIssued,
+		StateCallsFiltered,
+		// Global operator new calls made by render(), from HeapCounter
+		HeapAllocations,
+		NumCounters
+	};
+
+	struct Counters
+	{
+		uint64_t values[NumCounters] = {};
+
+		uint64_t operator[](Counter counter) const { return values[counter]; }
+	};
+
+	// camelCase, for reports
+	const char * name(Counter counter);
+
+	void count(Counter counter, uint64_t amount = 1);
+	// One draw call of indices indices, drawn instances times
+	void countDraw(uint64_t indices, uint64_t instances = 1);
+
+	// The frame so far, and the last one endFrame() closed
+	const Counters & current();
+	const Counters & lastFrame();
+	void endFrame();
+
+	// Every counter on one line
+	void print(std::ostream &out, const Counters &counters);
+
+}
+
+#endif // LAB471_RENDERSTATS_H_INCLUDED
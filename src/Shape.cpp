@@ -2,9 +2,13 @@
 #include "Shape.h"
 #include <iostream>
 #include <cassert>
+#include <cstring>
 
 #include "GLSL.h"
+#include "GLState.h"
+#include "Profiler.h"
 #include "Program.h"
+#include "RenderStats.h"
 
 using namespace std;
 using namespace glm;
@@ -16,10 +20,69 @@ void Shape::createShape(tinyobj::shape_t & shape)
 	norBuf = shape.mesh.normals;
 	texBuf = shape.mesh.texcoords;
 	eleBuf = shape.mesh.indices;
+	cache.reset();
+	mapped = MeshCache::Mesh();
+}
+
+// keep pointers into the mapped cache file; nothing is copied until init()
+// builds the GPU buffers from them
+void Shape::createShape(shared_ptr<const MeshCache> cache, const MeshCache::Mesh & mesh)
+{
+	posBuf.clear();
+	norBuf.clear();
+	texBuf.clear();
+	eleBuf.clear();
+	this->cache = std::move(cache);
+	mapped = mesh;
+}
+
+// area-weighted vertex normals for meshes that don't provide their own
+void Shape::generateNormals(const std::vector<float> &posBuf, const std::vector<unsigned int> &eleBuf, std::vector<float> &norBuf)
+{
+	generateNormals(posBuf.data(), posBuf.size() / 3, eleBuf.data(), eleBuf.size(), norBuf);
+}
+
+void Shape::generateNormals(const float *positions, size_t numVertices, const unsigned int *indices, size_t numIndices, std::vector<float> &norBuf)
+{
+	norBuf.assign(3*numVertices, 0.0f);
+
+	for (size_t i = 0; i < numIndices / 3; i++) {
+		int v0i = indices[3*i+0];
+		int v1i = indices[3*i+1];
+		int v2i = indices[3*i+2];
+
+		vec3 v0 = vec3(positions[3*v0i+0], positions[3*v0i+1], positions[3*v0i+2]);
+		vec3 v1 = vec3(positions[3*v1i+0], positions[3*v1i+1], positions[3*v1i+2]);
+		vec3 v2 = vec3(positions[3*v2i+0], positions[3*v2i+1], positions[3*v2i+2]);
+
+		vec3 fv = cross(v1-v0, v2-v0);
+
+		norBuf[3*v0i+0] += fv.x;
+		norBuf[3*v0i+1] += fv.y;
+		norBuf[3*v0i+2] += fv.z;
+		norBuf[3*v1i+0] += fv.x;
+		norBuf[3*v1i+1] += fv.y;
+		norBuf[3*v1i+2] += fv.z;
+		norBuf[3*v2i+0] += fv.x;
+		norBuf[3*v2i+1] += fv.y;
+		norBuf[3*v2i+2] += fv.z;
+	}
+
+	for (size_t i = 0; i < norBuf.size() / 3; i++) {
+		vec3 v = normalize(vec3(norBuf[3*i+0], norBuf[3*i+1], norBuf[3*i+2]));
+		norBuf[3*i+0] = v.x;
+		norBuf[3*i+1] = v.y;
+		norBuf[3*i+2] = v.z;
+	}
 }
 
 void Shape::tileCoords(float factor)
 {
+	// The mapped file is read-only, so scaled texcoords need their own copy
+	if (texBuf.empty() && mapped.texcoords)
+	{
+		texBuf.assign(mapped.texcoords, mapped.texcoords + 2*mapped.numVertices);
+	}
 	for (size_t i = 0; i < texBuf.size(); i++)
 	{
 		texBuf[i] = texBuf[i] * factor;
@@ -35,16 +98,17 @@ void Shape::measure()
 	maxX = maxY = maxZ = std::numeric_limits<float>::min();
 
 	//Go through all vertices to determine min and max of each dimension
-	for (size_t v = 0; v < posBuf.size() / 3; v++)
+	const float *positions = streamData(VertexStream::Position);
+	for (size_t v = 0; v < vertexCount(); v++)
 	{
-		if (posBuf[3*v+0] < minX) minX = posBuf[3 * v + 0];
-		if (posBuf[3*v+0] > maxX) maxX = posBuf[3 * v + 0];
+		if (positions[3*v+0] < minX) minX = positions[3 * v + 0];
+		if (positions[3*v+0] > maxX) maxX = positions[3 * v + 0];
 
-		if (posBuf[3*v+1] < minY) minY = posBuf[3 * v + 1];
-		if (posBuf[3*v+1] > maxY) maxY = posBuf[3 * v + 1];
+		if (positions[3*v+1] < minY) minY = positions[3 * v + 1];
+		if (positions[3*v+1] > maxY) maxY = positions[3 * v + 1];
 
-		if (posBuf[3*v+2] < minZ) minZ = posBuf[3 * v + 2];
-		if (posBuf[3*v+2] > maxZ) maxZ = posBuf[3 * v + 2];
+		if (positions[3*v+2] < minZ) minZ = positions[3 * v + 2];
+		if (positions[3*v+2] > maxZ) maxZ = positions[3 * v + 2];
 	}
 
 	min.x = minX;
@@ -55,133 +119,287 @@ void Shape::measure()
 	max.z = maxZ;
 }
 
-void Shape::init()
+void Shape::prepare()
 {
-	// Initialize the vertex array object
-	CHECKED_GL_CALL(glGenVertexArrays(1, &vaoID));
-	CHECKED_GL_CALL(glBindVertexArray(vaoID));
-
-	// Send the position array to the GPU
-	CHECKED_GL_CALL(glGenBuffers(1, &posBufID));
-	CHECKED_GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, posBufID));
-	CHECKED_GL_CALL(glBufferData(GL_ARRAY_BUFFER, posBuf.size()*sizeof(float), &posBuf[0], GL_STATIC_DRAW));
+	if (!streamData(VertexStream::Normal))
+	{
+		generateNormals(streamData(VertexStream::Position), vertexCount(), indexData(), indexCount(), norBuf);
+	}
+}
 
-	// Send the normal array to the GPU
-	if (norBuf.empty())
+const float * Shape::streamData(VertexStream stream) const
+{
+	switch (stream)
 	{
-		for (size_t i = 0; i < posBuf.size(); i++)
-		{
-			norBuf.push_back(0);
-		}
+	case VertexStream::Normal:
+		return !norBuf.empty() ? norBuf.data() : mapped.normals;
+	case VertexStream::Texcoord:
+		return !texBuf.empty() ? texBuf.data() : mapped.texcoords;
+	default:
+		return !posBuf.empty() ? posBuf.data() : mapped.positions;
+	}
+}
 
-		for (size_t i = 0; i < eleBuf.size() / 3; i++) {
-			int v0i = eleBuf[3*i+0];
-			int v1i = eleBuf[3*i+1];
-			int v2i = eleBuf[3*i+2];
-
-			vec3 v0 = vec3(posBuf[3*v0i+0], posBuf[3*v0i+1], posBuf[3*v0i+2]);
-			vec3 v1 = vec3(posBuf[3*v1i+0], posBuf[3*v1i+1], posBuf[3*v1i+2]);
-			vec3 v2 = vec3(posBuf[3*v2i+0], posBuf[3*v2i+1], posBuf[3*v2i+2]);
-
-			vec3 fv = cross(v1-v0, v2-v0);
-
-			norBuf[3*v0i+0] += fv.x;
-			norBuf[3*v0i+1] += fv.y;
-			norBuf[3*v0i+2] += fv.z;
-			norBuf[3*v1i+0] += fv.x;
-			norBuf[3*v1i+1] += fv.y;
-			norBuf[3*v1i+2] += fv.z;
-			norBuf[3*v2i+0] += fv.x;
-			norBuf[3*v2i+1] += fv.y;
-			norBuf[3*v2i+2] += fv.z;
-		}
+const unsigned int * Shape::indexData() const
+{
+	return !eleBuf.empty() ? eleBuf.data() : mapped.indices;
+}
+
+size_t Shape::vertexCount() const
+{
+	return cache ? mapped.numVertices : posBuf.size() / 3;
+}
+
+size_t Shape::indexCount() const
+{
+	return cache ? mapped.numIndices : eleBuf.size();
+}
 
-		for (size_t i = 0; i < norBuf.size() / 3; i++) {
-			vec3 v = normalize(vec3(norBuf[3*i+0], norBuf[3*i+1], norBuf[3*i+2]));
-			norBuf[3*i+0] = v.x;
-			norBuf[3*i+1] = v.y;
-			norBuf[3*i+2] = v.z;
+bool Shape::hasTexcoords() const
+{
+	return !texBuf.empty() ? texBuf.size() / 2 == vertexCount() : mapped.texcoords != nullptr;
+}
+
+// pack the separate arrays into one buffer of vertices, driven by the layout
+void Shape::interleave(const VertexLayout &layout, vector<unsigned char> &vertices) const
+{
+	const size_t numVertices = vertexCount();
+	vertices.assign(numVertices * layout.stride, 0);
+
+	for (const VertexAttribute &attribute : layout.attributes)
+	{
+		const float *src = streamData(attribute.stream);
+		const size_t bytes = attribute.size * sizeof(float);
+		unsigned char *dst = vertices.data() + attribute.offset;
+		for (size_t v = 0; v < numVertices; v++)
+		{
+			memcpy(dst, src, bytes);
+			src += attribute.size;
+			dst += layout.stride;
 		}
 	}
+}
 
-	CHECKED_GL_CALL(glGenBuffers(1, &norBufID));
-	CHECKED_GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, norBufID));
-	CHECKED_GL_CALL(glBufferData(GL_ARRAY_BUFFER, norBuf.size()*sizeof(float), &norBuf[0], GL_STATIC_DRAW));
+void Shape::init(Storage storage)
+{
+	GLSL::DebugGroup group("Shape::init");
 
+	// Normals are needed by both storage modes
+	prepare();
 
-	// Send the texture array to the GPU
-	if (texBuf.empty())
+	if (storage == Storage::Interleaved)
 	{
-		texBufID = 0;
+		// Position, normal and texcoord side by side in one buffer. The
+		// streams are stored apart (in the cache file too), so this is the
+		// one pass that packs them, into a buffer freed right after upload.
+		layout = hasTexcoords() ? &VertexFormat<VertexPNT>::layout() : &VertexFormat<VertexPN>::layout();
+
+		vector<unsigned char> vertices;
+		interleave(*layout, vertices);
+
+		CHECKED_GL_CALL(glGenBuffers(1, &vertBufID));
+		GLState::bindBuffer(GL_ARRAY_BUFFER, vertBufID);
+		CHECKED_GL_CALL(glBufferData(GL_ARRAY_BUFFER, vertices.size(), vertices.data(), GL_STATIC_DRAW));
+		RenderStats::count(RenderStats::BufferBytes, vertices.size());
 	}
 	else
 	{
-		CHECKED_GL_CALL(glGenBuffers(1, &texBufID));
-		CHECKED_GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, texBufID));
-		CHECKED_GL_CALL(glBufferData(GL_ARRAY_BUFFER, texBuf.size()*sizeof(float), &texBuf[0], GL_STATIC_DRAW));
+		// Send the position array to the GPU
+		const size_t streamBytes = 3*vertexCount()*sizeof(float);
+		CHECKED_GL_CALL(glGenBuffers(1, &posBufID));
+		GLState::bindBuffer(GL_ARRAY_BUFFER, posBufID);
+		CHECKED_GL_CALL(glBufferData(GL_ARRAY_BUFFER, streamBytes, streamData(VertexStream::Position), GL_STATIC_DRAW));
+		RenderStats::count(RenderStats::BufferBytes, streamBytes);
+
+		// Send the normal array to the GPU
+		CHECKED_GL_CALL(glGenBuffers(1, &norBufID));
+		GLState::bindBuffer(GL_ARRAY_BUFFER, norBufID);
+		CHECKED_GL_CALL(glBufferData(GL_ARRAY_BUFFER, streamBytes, streamData(VertexStream::Normal), GL_STATIC_DRAW));
+		RenderStats::count(RenderStats::BufferBytes, streamBytes);
+
+		// Send the texture array to the GPU
+		if (!hasTexcoords())
+		{
+			texBufID = 0;
+		}
+		else
+		{
+			const size_t texBytes = 2*vertexCount()*sizeof(float);
+			CHECKED_GL_CALL(glGenBuffers(1, &texBufID));
+			GLState::bindBuffer(GL_ARRAY_BUFFER, texBufID);
+			CHECKED_GL_CALL(glBufferData(GL_ARRAY_BUFFER, texBytes, streamData(VertexStream::Texcoord), GL_STATIC_DRAW));
+			RenderStats::count(RenderStats::BufferBytes, texBytes);
+		}
 	}
 
-	// Send the element array to the GPU
+	// Send the element array to the GPU. The element binding belongs to
+	// whichever VAO is bound, so upload through a target that doesn't;
+	// the VAOs attach the buffer when they are built.
+	elementCount = indexCount();
 	CHECKED_GL_CALL(glGenBuffers(1, &eleBufID));
-	CHECKED_GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eleBufID));
-	CHECKED_GL_CALL(glBufferData(GL_ELEMENT_ARRAY_BUFFER, eleBuf.size()*sizeof(unsigned int), &eleBuf[0], GL_STATIC_DRAW));
+	GLState::bindBuffer(GL_COPY_WRITE_BUFFER, eleBufID);
+	CHECKED_GL_CALL(glBufferData(GL_COPY_WRITE_BUFFER, elementCount*sizeof(unsigned int), indexData(), GL_STATIC_DRAW));
+	RenderStats::count(RenderStats::BufferBytes, elementCount*sizeof(unsigned int));
 
 	// Unbind the arrays
-	CHECKED_GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0));
-	CHECKED_GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+	GLState::bindBuffer(GL_ARRAY_BUFFER, 0);
+	GLState::bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	// Everything is on the GPU now, so the cache file can be unmapped
+	cache.reset();
+	mapped = MeshCache::Mesh();
+}
+
+void Shape::setInstances(const std::vector<glm::mat4> &transforms)
+{
+	setInstances(transforms.empty() ? nullptr : &transforms[0], transforms.size());
+}
+
+void Shape::setInstances(const glm::mat4 *transforms, size_t count)
+{
+	// Must be called after init(). The buffer name never changes afterwards,
+	// so instanced VAOs stay valid across updates.
+	if (instBufID == 0)
+	{
+		CHECKED_GL_CALL(glGenBuffers(1, &instBufID));
+	}
+
+	instanceCount = (int)count;
+	// Runs every frame, so the buffer is left bound rather than reset
+	GLState::bindBuffer(GL_ARRAY_BUFFER, instBufID);
+	CHECKED_GL_CALL(glBufferData(GL_ARRAY_BUFFER, count*sizeof(mat4), transforms, GL_DYNAMIC_DRAW));
+	RenderStats::count(RenderStats::BufferBytes, count*sizeof(mat4));
 }
 
 void Shape::draw(const shared_ptr<Program> prog) const
 {
-	int h_pos, h_nor, h_tex;
-	h_pos = h_nor = h_tex = -1;
+	drawElements(prog, false);
+}
 
-	CHECKED_GL_CALL(glBindVertexArray(vaoID));
+void Shape::drawInstanced(const shared_ptr<Program> prog) const
+{
+	if (instBufID != 0 && instanceCount > 0)
+	{
+		drawElements(prog, true);
+	}
+}
 
-	// Bind position buffer
-	h_pos = prog->getAttribute("vertPos");
-	GLSL::enableVertexAttribArray(h_pos);
-	CHECKED_GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, posBufID));
-	CHECKED_GL_CALL(glVertexAttribPointer(h_pos, 3, GL_FLOAT, GL_FALSE, 0, (const void *)0));
+void Shape::drawElements(const shared_ptr<Program> prog, bool instanced) const
+{
+	PROFILE_SCOPE("Shape::draw");
+
+	// All attribute state lives in the VAO, so a draw is a bind and a call
+	GLState::bindVertexArray(vertexArrayFor(*prog, instanced));
 
-	// Bind normal buffer
-	h_nor = prog->getAttribute("vertNor");
-	if (h_nor != -1 && norBufID != 0)
+	if (instanced)
 	{
-		GLSL::enableVertexAttribArray(h_nor);
-		CHECKED_GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, norBufID));
-		CHECKED_GL_CALL(glVertexAttribPointer(h_nor, 3, GL_FLOAT, GL_FALSE, 0, (const void *)0));
+		CHECKED_GL_CALL(glDrawElementsInstanced(GL_TRIANGLES, (int)elementCount, GL_UNSIGNED_INT, (const void *)0, instanceCount));
+		RenderStats::countDraw(elementCount, instanceCount);
+	}
+	else
+	{
+		CHECKED_GL_CALL(glDrawElements(GL_TRIANGLES, (int)elementCount, GL_UNSIGNED_INT, (const void *)0));
+		RenderStats::countDraw(elementCount);
 	}
+}
+
+void Shape::drawRanges(const shared_ptr<Program> prog, const GLsizei *counts, const void * const *offsets, const GLint *baseVertices, GLsizei numRanges) const
+{
+	PROFILE_SCOPE("Shape::drawRanges");
 
-	if (texBufID != 0)
+	if (numRanges > 0)
 	{
-		// Bind texcoords buffer
-		h_tex = prog->getAttribute("vertTex");
+		GLState::bindVertexArray(vertexArrayFor(*prog, false));
+		CHECKED_GL_CALL(glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts, GL_UNSIGNED_INT, offsets, numRanges, baseVertices));
 
-		if (h_tex != -1 && texBufID != 0)
+		// One call to the driver, however many ranges
+		uint64_t indices = 0;
+		for (GLsizei i = 0; i < numRanges; i++)
 		{
-			GLSL::enableVertexAttribArray(h_tex);
-			CHECKED_GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, texBufID));
-			CHECKED_GL_CALL(glVertexAttribPointer(h_tex, 2, GL_FLOAT, GL_FALSE, 0, (const void *)0));
+			indices += counts[i];
 		}
+		RenderStats::countDraw(indices);
 	}
+}
 
-	// Bind element buffer
-	CHECKED_GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eleBufID));
+unsigned int Shape::vertexArrayFor(const Program &prog, bool instanced) const
+{
+	const unsigned int layoutKey = prog.getVertexLayout();
+	for (const VertexArray &vertexArray : vertexArrays)
+	{
+		if (vertexArray.layoutKey == layoutKey && vertexArray.instanced == instanced)
+		{
+			return vertexArray.vaoID;
+		}
+	}
 
-	// Draw
-	CHECKED_GL_CALL(glDrawElements(GL_TRIANGLES, (int)eleBuf.size(), GL_UNSIGNED_INT, (const void *)0));
+	VertexArray vertexArray;
+	vertexArray.layoutKey = layoutKey;
+	vertexArray.instanced = instanced;
+	vertexArray.vaoID = buildVertexArray(prog, instanced);
+	vertexArrays.push_back(vertexArray);
+	return vertexArray.vaoID;
+}
+
+unsigned int Shape::buildVertexArray(const Program &prog, bool instanced) const
+{
+	unsigned int vao = 0;
+	CHECKED_GL_CALL(glGenVertexArrays(1, &vao));
+	GLState::bindVertexArray(vao);
 
-	// Disable and unbind
-	if (h_tex != -1)
+	if (layout)
 	{
-		GLSL::disableVertexAttribArray(h_tex);
+		// One buffer, one pointer per attribute in the vertex format
+		GLState::bindBuffer(GL_ARRAY_BUFFER, vertBufID);
+		for (const VertexAttribute &attribute : layout->attributes)
+		{
+			GLint h = prog.getVertexLocation((int)attribute.stream);
+			GLSL::enableVertexAttribArray(h);
+			CHECKED_GL_CALL(glVertexAttribPointer(h, attribute.size, GL_FLOAT, GL_FALSE, layout->stride, (const void *)attribute.offset));
+		}
 	}
-	if (h_nor != -1)
+	else
 	{
-		GLSL::disableVertexAttribArray(h_nor);
+		// Bind position buffer
+		GLint h_pos = prog.getVertexLocation((int)VertexStream::Position);
+		GLSL::enableVertexAttribArray(h_pos);
+		GLState::bindBuffer(GL_ARRAY_BUFFER, posBufID);
+		CHECKED_GL_CALL(glVertexAttribPointer(h_pos, 3, GL_FLOAT, GL_FALSE, 0, (const void *)0));
+
+		// Bind normal buffer
+		GLint h_nor = prog.getVertexLocation((int)VertexStream::Normal);
+		GLSL::enableVertexAttribArray(h_nor);
+		GLState::bindBuffer(GL_ARRAY_BUFFER, norBufID);
+		CHECKED_GL_CALL(glVertexAttribPointer(h_nor, 3, GL_FLOAT, GL_FALSE, 0, (const void *)0));
+
+		if (texBufID != 0)
+		{
+			// Bind texcoords buffer
+			GLint h_tex = prog.getVertexLocation((int)VertexStream::Texcoord);
+			GLSL::enableVertexAttribArray(h_tex);
+			GLState::bindBuffer(GL_ARRAY_BUFFER, texBufID);
+			CHECKED_GL_CALL(glVertexAttribPointer(h_tex, 2, GL_FLOAT, GL_FALSE, 0, (const void *)0));
+		}
+	}
+
+	if (instanced)
+	{
+		// Bind instance transforms, one mat4 column per attribute location.
+		// Non-instanced VAOs leave these disabled and read the identity
+		// current value instead.
+		GLint h_inst = prog.getVertexLocation(InstanceSlot);
+		GLState::bindBuffer(GL_ARRAY_BUFFER, instBufID);
+		for (int i = 0; i < 4; i++)
+		{
+			GLSL::enableVertexAttribArray(h_inst + i);
+			CHECKED_GL_CALL(glVertexAttribPointer(h_inst + i, 4, GL_FLOAT, GL_FALSE, sizeof(mat4), (const void *)(sizeof(vec4) * i)));
+			CHECKED_GL_CALL(glVertexAttribDivisor(h_inst + i, 1));
+		}
 	}
-	GLSL::disableVertexAttribArray(h_pos);
-	CHECKED_GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0));
-	CHECKED_GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+
+	// Bind element buffer
+	GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, eleBufID);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, 0);
+
+	return vao;
 }
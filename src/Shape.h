@@ -14,6 +14,9 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <tiny_obj_loader/tiny_obj_loader.h>
 
+#include "MeshCache.h"
+#include "VertexFormat.h"
+
 class Program;
 
 
@@ -22,26 +25,85 @@ class Shape
 
 public:
 
+	// How init() stores vertices on the GPU: one buffer per attribute, or a
+	// single buffer of interleaved vertices described by a VertexFormat
+	enum class Storage
+	{
+		Separate,
+		Interleaved
+	};
+
 	void createShape(tinyobj::shape_t & shape);
+	// Reads mesh in place from cache's mapped file instead of copying it;
+	// the shape keeps cache alive until init() has uploaded the data
+	void createShape(std::shared_ptr<const MeshCache> cache, const MeshCache::Mesh & mesh);
 	void tileCoords(float factor);
-	void init();
+	// CPU-side setup init() would otherwise do (normal generation); touches
+	// no GL state, so it can run on a loader thread
+	void prepare();
+	void init(Storage storage = Storage::Interleaved);
 	void measure();
 	void draw(const std::shared_ptr<Program> prog) const;
 
+	// Per-instance model transforms, read by the "instM" vertex attribute
+	void setInstances(const std::vector<glm::mat4> &transforms);
+	void setInstances(const glm::mat4 *transforms, size_t count);
+	void drawInstanced(const std::shared_ptr<Program> prog) const;
+
+	// Draws several index ranges with one call, each with its own base
+	// vertex, for shapes whose element buffer holds more than one mesh
+	void drawRanges(const std::shared_ptr<Program> prog, const GLsizei *counts, const void * const *offsets, const GLint *baseVertices, GLsizei numRanges) const;
+
+	static void generateNormals(const std::vector<float> &posBuf, const std::vector<unsigned int> &eleBuf, std::vector<float> &norBuf);
+	static void generateNormals(const float *positions, size_t numVertices, const unsigned int *indices, size_t numIndices, std::vector<float> &norBuf);
+
 	glm::vec3 min = glm::vec3(0);
 	glm::vec3 max = glm::vec3(0);
 
 private:
 
+	// Packs many shapes into one
+	friend class MeshPool;
+
+	void drawElements(const std::shared_ptr<Program> prog, bool instanced) const;
+	unsigned int vertexArrayFor(const Program &prog, bool instanced) const;
+	unsigned int buildVertexArray(const Program &prog, bool instanced) const;
+	// The vertex data, from the buffers below or the mapped cache. A null
+	// stream is one the shape doesn't have.
+	const float * streamData(VertexStream stream) const;
+	const unsigned int * indexData() const;
+	size_t vertexCount() const;
+	size_t indexCount() const;
+	bool hasTexcoords() const;
+	void interleave(const VertexLayout &layout, std::vector<unsigned char> &vertices) const;
+
 	std::vector<unsigned int> eleBuf;
 	std::vector<float> posBuf;
 	std::vector<float> norBuf;
 	std::vector<float> texBuf;
+	// A cached mesh read in place until init() uploads it. Streams filled
+	// in the buffers above (generated normals, tiled texcoords) win.
+	std::shared_ptr<const MeshCache> cache;
+	MeshCache::Mesh mapped;
+	// Indices uploaded by init()
+	size_t elementCount = 0;
 	unsigned int eleBufID = 0;
 	unsigned int posBufID = 0;
 	unsigned int norBufID = 0;
 	unsigned int texBufID = 0;
-	unsigned int vaoID = 0;
+	unsigned int vertBufID = 0;
+	// Set when the vertices are interleaved in vertBufID
+	const VertexLayout *layout = nullptr;
+	unsigned int instBufID = 0;
+	// One VAO per program vertex layout (and instancing), built on first draw
+	struct VertexArray
+	{
+		unsigned int layoutKey;
+		bool instanced;
+		unsigned int vaoID;
+	};
+	mutable std::vector<VertexArray> vertexArrays;
+	int instanceCount = 0;
 
 };
 
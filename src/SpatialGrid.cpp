@@ -0,0 +1,425 @@
+
+#include "SpatialGrid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+using namespace std;
+using namespace glm;
+
+namespace
+{
+
+// Runs fn(0) .. fn(threads - 1), all but the last on their own thread
+template <typename Fn>
+void parallelFor(unsigned int threads, Fn fn)
+{
+	vector<thread> workers;
+	for (unsigned int t = 0; t + 1 < threads; t++)
+	{
+		workers.push_back(thread(fn, t));
+	}
+	fn(threads - 1);
+	for (thread &worker : workers)
+	{
+		worker.join();
+	}
+}
+
+// Below this many spheres a single thread is faster than starting more
+const size_t ParallelThreshold = 65536;
+
+}
+
+void SpatialGrid::clear()
+{
+	dimX = dimZ = 0;
+	maxRadius = 0.0f;
+	cellStart.clear();
+	levels.clear();
+	sorted.clear();
+	ids.clear();
+}
+
+int SpatialGrid::cellX(float x) const
+{
+	return std::min(std::max((int) floor((x - origin.x) / cellSize), 0), dimX - 1);
+}
+
+int SpatialGrid::cellZ(float z) const
+{
+	return std::min(std::max((int) floor((z - origin.y) / cellSize), 0), dimZ - 1);
+}
+
+void SpatialGrid::build(const BoundingSpheres &spheres, float size, unsigned int threads)
+{
+	clear();
+
+	const size_t n = spheres.size();
+	if (n == 0)
+	{
+		return;
+	}
+
+	if (threads == 0)
+	{
+		threads = n < ParallelThreshold ? 1 : std::max(1u, thread::hardware_concurrency());
+	}
+	threads = (unsigned int) std::min<size_t>(threads, n);
+	const size_t chunk = (n + threads - 1) / threads;
+
+	// Extents of the centers, per thread then merged
+	vector<vec4> lo(threads, vec4(numeric_limits<float>::max()));
+	vector<vec4> hi(threads, vec4(-numeric_limits<float>::max()));
+	parallelFor(threads, [&](unsigned int t)
+	{
+		const size_t end = std::min(n, (t + 1) * chunk);
+		for (size_t i = t * chunk; i < end; i++)
+		{
+			lo[t] = min(lo[t], vec4(spheres.x[i], spheres.z[i], 0.0f, 0.0f));
+			hi[t] = max(hi[t], vec4(spheres.x[i], spheres.z[i], spheres.radius[i], 0.0f));
+		}
+	});
+	vec4 boundsMin = lo[0];
+	vec4 boundsMax = hi[0];
+	for (unsigned int t = 1; t < threads; t++)
+	{
+		boundsMin = min(boundsMin, lo[t]);
+		boundsMax = max(boundsMax, hi[t]);
+	}
+	maxRadius = boundsMax.z;
+
+	const float width = std::max(boundsMax.x - boundsMin.x, 1e-3f);
+	const float depth = std::max(boundsMax.y - boundsMin.y, 1e-3f);
+	cellSize = size > 0.0f ? size : sqrt(width * depth * itemsPerCell / (float) n);
+	cellSize = std::max(cellSize, 1e-3f);
+	origin = vec2(boundsMin.x, boundsMin.y);
+	dimX = std::max(1, (int) ceil(width / cellSize));
+	dimZ = std::max(1, (int) ceil(depth / cellSize));
+	const size_t cells = (size_t) dimX * dimZ;
+
+	// Counting sort by cell: each thread counts its own chunk...
+	vector<uint32_t> cellOf(n);
+	vector<vector<uint32_t>> counts(threads, vector<uint32_t>(cells, 0));
+	parallelFor(threads, [&](unsigned int t)
+	{
+		const size_t end = std::min(n, (t + 1) * chunk);
+		for (size_t i = t * chunk; i < end; i++)
+		{
+			cellOf[i] = (uint32_t) (cellZ(spheres.z[i]) * dimX + cellX(spheres.x[i]));
+			counts[t][cellOf[i]]++;
+		}
+	});
+
+	// ...the counts become per-thread write offsets, keeping input order
+	// within a cell so the result doesn't depend on the thread count...
+	cellStart.resize(cells + 1);
+	uint32_t running = 0;
+	for (size_t c = 0; c < cells; c++)
+	{
+		cellStart[c] = running;
+		for (unsigned int t = 0; t < threads; t++)
+		{
+			uint32_t count = counts[t][c];
+			counts[t][c] = running;
+			running += count;
+		}
+	}
+	cellStart[cells] = running;
+
+	// ...and each thread scatters its chunk
+	ids.resize(n);
+	sorted.x.resize(n);
+	sorted.y.resize(n);
+	sorted.z.resize(n);
+	sorted.radius.resize(n);
+	parallelFor(threads, [&](unsigned int t)
+	{
+		const size_t end = std::min(n, (t + 1) * chunk);
+		for (size_t i = t * chunk; i < end; i++)
+		{
+			uint32_t to = counts[t][cellOf[i]]++;
+			ids[to] = (uint32_t) i;
+			sorted.x[to] = spheres.x[i];
+			sorted.y[to] = spheres.y[i];
+			sorted.z[to] = spheres.z[i];
+			sorted.radius[to] = spheres.radius[i];
+		}
+	});
+
+	// Loose bounds of each cell's spheres
+	const vec3 emptyMin = vec3(numeric_limits<float>::max());
+	const vec3 emptyMax = vec3(-numeric_limits<float>::max());
+	levels.resize(1);
+	levels[0].dimX = dimX;
+	levels[0].dimZ = dimZ;
+	levels[0].min.assign(cells, emptyMin);
+	levels[0].max.assign(cells, emptyMax);
+	const size_t cellChunk = (cells + threads - 1) / threads;
+	parallelFor(threads, [&](unsigned int t)
+	{
+		const size_t end = std::min(cells, (t + 1) * cellChunk);
+		for (size_t c = t * cellChunk; c < end; c++)
+		{
+			vec3 bmin = emptyMin;
+			vec3 bmax = emptyMax;
+			for (uint32_t i = cellStart[c]; i < cellStart[c + 1]; i++)
+			{
+				vec3 center = vec3(sorted.x[i], sorted.y[i], sorted.z[i]);
+				bmin = min(bmin, center - vec3(sorted.radius[i]));
+				bmax = max(bmax, center + vec3(sorted.radius[i]));
+			}
+			levels[0].min[c] = bmin;
+			levels[0].max[c] = bmax;
+		}
+	});
+
+	// Each pyramid level merges 2x2 nodes of the one below. Empty nodes
+	// merge away, since their bounds are inverted.
+	while (levels.back().dimX > 1 || levels.back().dimZ > 1)
+	{
+		const Level &below = levels.back();
+		Level level;
+		level.dimX = (below.dimX + 1) / 2;
+		level.dimZ = (below.dimZ + 1) / 2;
+		level.min.assign((size_t) level.dimX * level.dimZ, emptyMin);
+		level.max.assign((size_t) level.dimX * level.dimZ, emptyMax);
+		for (int z = 0; z < below.dimZ; z++)
+		{
+			for (int x = 0; x < below.dimX; x++)
+			{
+				const size_t from = (size_t) z * below.dimX + x;
+				const size_t to = (size_t) (z / 2) * level.dimX + x / 2;
+				level.min[to] = min(level.min[to], below.min[from]);
+				level.max[to] = max(level.max[to], below.max[from]);
+			}
+		}
+		levels.push_back(std::move(level));
+	}
+}
+
+void SpatialGrid::queryFrustum(const Frustum &frustum, vector<uint32_t> &out) const
+{
+	out.clear();
+	if (!empty())
+	{
+		queryNode(frustum, (int) levels.size() - 1, 0, 0, out);
+	}
+}
+
+void SpatialGrid::queryNode(const Frustum &frustum, int level, int nx, int nz, vector<uint32_t> &out) const
+{
+	const Level &l = levels[level];
+	const size_t node = (size_t) nz * l.dimX + nx;
+	if (l.min[node].x > l.max[node].x)
+	{
+		return;
+	}
+
+	switch (frustum.classifyBox(l.min[node], l.max[node]))
+	{
+	case Frustum::INSIDE:
+		appendNode(level, nx, nz, out);
+		break;
+	case Frustum::INTERSECTS:
+		if (level > 0)
+		{
+			const Level &below = levels[level - 1];
+			for (int z = nz * 2; z < std::min(nz * 2 + 2, below.dimZ); z++)
+			{
+				for (int x = nx * 2; x < std::min(nx * 2 + 2, below.dimX); x++)
+				{
+					queryNode(frustum, level - 1, x, z, out);
+				}
+			}
+		}
+		else
+		{
+			// Sorted positions come back; map them to the caller's indices
+			const uint32_t begin = cellStart[node];
+			const uint32_t end = cellStart[node + 1];
+			size_t first = out.size();
+			frustum.cull(sorted, begin, end, out);
+			for (size_t i = first; i < out.size(); i++)
+			{
+				out[i] = ids[out[i]];
+			}
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+// Every sphere under a node. Its cells are contiguous within each row.
+void SpatialGrid::appendNode(int level, int nx, int nz, vector<uint32_t> &out) const
+{
+	const int x0 = nx << level;
+	const int x1 = std::min((nx + 1) << level, dimX);
+	const int z0 = nz << level;
+	const int z1 = std::min((nz + 1) << level, dimZ);
+	for (int z = z0; z < z1; z++)
+	{
+		const size_t row = (size_t) z * dimX;
+		out.insert(out.end(), ids.begin() + cellStart[row + x0], ids.begin() + cellStart[row + x1]);
+	}
+}
+
+void SpatialGrid::queryRadius(const vec3 &center, float radius, vector<uint32_t> &out) const
+{
+	out.clear();
+	if (empty())
+	{
+		return;
+	}
+
+	// Spheres can reach maxRadius outside their own cell
+	const float reach = radius + maxRadius;
+	const int x0 = cellX(center.x - reach);
+	const int x1 = cellX(center.x + reach);
+	const int z0 = cellZ(center.z - reach);
+	const int z1 = cellZ(center.z + reach);
+
+	for (int cz = z0; cz <= z1; cz++)
+	{
+		for (int cx = x0; cx <= x1; cx++)
+		{
+			const size_t c = (size_t) cz * dimX + cx;
+			for (uint32_t i = cellStart[c]; i < cellStart[c + 1]; i++)
+			{
+				vec3 d = vec3(sorted.x[i], sorted.y[i], sorted.z[i]) - center;
+				float r = radius + sorted.radius[i];
+				if (dot(d, d) <= r * r)
+				{
+					out.push_back(ids[i]);
+				}
+			}
+		}
+	}
+}
+
+bool SpatialGrid::testCell(int cx, int cz, const vec3 &rayOrigin, const vec3 &dir, float maxDist, uint32_t &hit, float &t) const
+{
+	bool found = false;
+	const size_t c = (size_t) cz * dimX + cx;
+	for (uint32_t i = cellStart[c]; i < cellStart[c + 1]; i++)
+	{
+		// Ray against sphere, taking the entry point (or 0 from inside)
+		vec3 oc = rayOrigin - vec3(sorted.x[i], sorted.y[i], sorted.z[i]);
+		float b = dot(oc, dir);
+		float cc = dot(oc, oc) - sorted.radius[i] * sorted.radius[i];
+		float disc = b * b - cc;
+		if (disc < 0.0f)
+		{
+			continue;
+		}
+		float s = -b - sqrt(disc);
+		if (s < 0.0f)
+		{
+			s = cc <= 0.0f ? 0.0f : -1.0f;
+		}
+		if (s >= 0.0f && s <= maxDist && s < t)
+		{
+			t = s;
+			hit = ids[i];
+			found = true;
+		}
+	}
+	return found;
+}
+
+bool SpatialGrid::raycast(const vec3 &rayOrigin, const vec3 &dir, float maxDist, uint32_t &hit, float &t) const
+{
+	if (empty())
+	{
+		return false;
+	}
+
+	// Walk the cells under the ray in XZ (Amanatides & Woo). A sphere can hit
+	// the ray up to `reach` cells away from its own, so each step also tests
+	// that neighbourhood; once the best hit is nearer than the far side of
+	// the current cell nothing later can beat it.
+	const int reach = (int) ceil(maxRadius / cellSize);
+	const float inf = numeric_limits<float>::max();
+	float best = inf;
+
+	// Clip the ray to the grid, grown by reach cells, so the walk starts
+	// at the first cell that can matter
+	const float pad = reach * cellSize;
+	const vec2 gridMin = origin - vec2(pad);
+	const vec2 gridMax = origin + vec2(dimX * cellSize + pad, dimZ * cellSize + pad);
+	float tEnter = 0.0f;
+	float tLeave = maxDist;
+	for (int axis = 0; axis < 2; axis++)
+	{
+		const float o = axis == 0 ? rayOrigin.x : rayOrigin.z;
+		const float d = axis == 0 ? dir.x : dir.z;
+		const float lo = axis == 0 ? gridMin.x : gridMin.y;
+		const float hi = axis == 0 ? gridMax.x : gridMax.y;
+		if (d == 0.0f)
+		{
+			if (o < lo || o > hi)
+			{
+				return false;
+			}
+			continue;
+		}
+		float t0 = (lo - o) / d;
+		float t1 = (hi - o) / d;
+		tEnter = std::max(tEnter, std::min(t0, t1));
+		tLeave = std::min(tLeave, std::max(t0, t1));
+	}
+	if (tEnter > tLeave)
+	{
+		return false;
+	}
+
+	const vec3 start = rayOrigin + dir * tEnter;
+	int cx = std::min(std::max((int) floor((start.x - origin.x) / cellSize), -reach), dimX + reach - 1);
+	int cz = std::min(std::max((int) floor((start.z - origin.y) / cellSize), -reach), dimZ + reach - 1);
+	const int stepX = dir.x > 0.0f ? 1 : -1;
+	const int stepZ = dir.z > 0.0f ? 1 : -1;
+	const float deltaX = dir.x != 0.0f ? cellSize / fabs(dir.x) : inf;
+	const float deltaZ = dir.z != 0.0f ? cellSize / fabs(dir.z) : inf;
+	const float edgeX = origin.x + (cx + (stepX > 0 ? 1 : 0)) * cellSize;
+	const float edgeZ = origin.y + (cz + (stepZ > 0 ? 1 : 0)) * cellSize;
+	float nextX = dir.x != 0.0f ? (edgeX - rayOrigin.x) / dir.x : inf;
+	float nextZ = dir.z != 0.0f ? (edgeZ - rayOrigin.z) / dir.z : inf;
+
+	while (true)
+	{
+		for (int z = std::max(cz - reach, 0); z <= std::min(cz + reach, dimZ - 1); z++)
+		{
+			for (int x = std::max(cx - reach, 0); x <= std::min(cx + reach, dimX - 1); x++)
+			{
+				testCell(x, z, rayOrigin, dir, maxDist, hit, best);
+			}
+		}
+
+		const float cellExit = std::min(nextX, nextZ);
+		if (best <= cellExit || cellExit > tLeave)
+		{
+			break;
+		}
+
+		if (nextX < nextZ)
+		{
+			cx += stepX;
+			nextX += deltaX;
+		}
+		else
+		{
+			cz += stepZ;
+			nextZ += deltaZ;
+		}
+	}
+
+	if (best <= maxDist)
+	{
+		t = best;
+		return true;
+	}
+	return false;
+}
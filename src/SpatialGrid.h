@@ -0,0 +1,86 @@
+
+#pragma once
+
+#ifndef LAB471_SPATIALGRID_H_INCLUDED
+#define LAB471_SPATIALGRID_H_INCLUDED
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Frustum.h"
+
+
+// A loose uniform grid over the XZ plane holding bounding spheres.
+//
+// Every sphere lives in the one cell containing its center, and each cell
+// keeps the box around its spheres. A min/max pyramid over those boxes lets
+// frustum queries accept or reject whole blocks of cells at once, so their
+// cost follows what is near the frustum's boundary rather than the grid size.
+// Spheres are stored sorted by cell, which lets the partly visible cells go
+// through Frustum::cull's SIMD path in one contiguous run.
+// Queries return the sphere indices that were passed to build().
+class SpatialGrid
+{
+
+public:
+
+	// Rebuilds from scratch. cellSize 0 picks one that averages about
+	// itemsPerCell spheres per cell; threads 0 uses every hardware thread
+	// for large inputs.
+	void build(const BoundingSpheres &spheres, float cellSize = 0.0f, unsigned int threads = 0);
+	void clear();
+
+	size_t size() const { return ids.size(); }
+	bool empty() const { return ids.empty(); }
+
+	// Spheres at least partly inside the frustum (cleared first)
+	void queryFrustum(const Frustum &frustum, std::vector<uint32_t> &out) const;
+
+	// Spheres overlapping the sphere at center with the given radius (cleared first)
+	void queryRadius(const glm::vec3 &center, float radius, std::vector<uint32_t> &out) const;
+
+	// Nearest sphere hit by the ray within maxDist, for picking. dir must be
+	// normalized; t is the distance to the hit.
+	bool raycast(const glm::vec3 &origin, const glm::vec3 &dir, float maxDist, uint32_t &hit, float &t) const;
+
+	static const int itemsPerCell = 16;
+
+private:
+
+	int cellX(float x) const;
+	int cellZ(float z) const;
+	bool testCell(int cx, int cz, const glm::vec3 &origin, const glm::vec3 &dir, float maxDist, uint32_t &hit, float &t) const;
+	void queryNode(const Frustum &frustum, int level, int nx, int nz, std::vector<uint32_t> &out) const;
+	void appendNode(int level, int nx, int nz, std::vector<uint32_t> &out) const;
+
+	glm::vec2 origin = glm::vec2(0);
+	float cellSize = 1.0f;
+	int dimX = 0;
+	int dimZ = 0;
+	// Largest radius; bounds how far a sphere can reach outside its cell
+	float maxRadius = 0.0f;
+
+	// Cell c owns sorted entries [cellStart[c], cellStart[c+1])
+	std::vector<uint32_t> cellStart;
+
+	// Bounds pyramid: level 0 holds each cell's box, and every node above
+	// covers 2x2 nodes of the level below, up to a single root. Empty nodes
+	// have min > max.
+	struct Level
+	{
+		int dimX;
+		int dimZ;
+		std::vector<glm::vec3> min;
+		std::vector<glm::vec3> max;
+	};
+	std::vector<Level> levels;
+
+	// Spheres sorted by cell, and the index each one had in build()
+	BoundingSpheres sorted;
+	std::vector<uint32_t> ids;
+
+};
+
+#endif // LAB471_SPATIALGRID_H_INCLUDED
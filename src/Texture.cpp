@@ -1,8 +1,13 @@
 #include "Texture.h"
 #include "GLSL.h"
+#include "GLState.h"
+#include "Profiler.h"
+#include "RenderStats.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <iostream>
+#include <cstring>
+#include <vector>
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
@@ -10,24 +15,37 @@ using namespace std;
 
 Texture::Texture() :
 	filename(""),
-	tid(0)
+	tid(0),
+	data(nullptr)
 {
 	
 }
 
 Texture::~Texture()
 {
-	
+	if (data)
+	{
+		stbi_image_free(data);
+	}
 }
 
 void Texture::init()
 {
+	PROFILE_SCOPE("Texture::init");
+	load();
+	upload();
+}
+
+bool Texture::load()
+{
+	PROFILE_SCOPE("Texture::load");
+
 	// Load texture
 	int w, h, ncomps;
-	stbi_set_flip_vertically_on_load(true);
-	unsigned char *data = stbi_load(filename.c_str(), &w, &h, &ncomps, 0);
+	data = stbi_load(filename.c_str(), &w, &h, &ncomps, 0);
 	if(!data) {
 		cerr << filename << " not found" << endl;
+		return false;
 	}
 	if(ncomps != 3) {
 		cerr << filename << " must have 3 components (RGB)" << endl;
@@ -38,10 +56,36 @@ void Texture::init()
 	width = w;
 	height = h;
 
+	// Flip rows here rather than with stbi_set_flip_vertically_on_load(),
+	// which is a global flag and not safe with several loader threads
+	size_t stride = (size_t)width * ncomps;
+	vector<unsigned char> row(stride);
+	for (int y = 0; y < height / 2; y++)
+	{
+		unsigned char *top = data + y * stride;
+		unsigned char *bottom = data + (height - 1 - y) * stride;
+		memcpy(row.data(), top, stride);
+		memcpy(top, bottom, stride);
+		memcpy(bottom, row.data(), stride);
+	}
+	return true;
+}
+
+void Texture::upload()
+{
+	PROFILE_SCOPE("Texture::upload");
+
+	if (!data)
+	{
+		return;
+	}
+
+	GLSL::DebugGroup group("Texture::upload");
+
 	// Generate a texture buffer object
 	glGenTextures(1, &tid);
 	// Bind the current texture to be the newly generated texture object
-	glBindTexture(GL_TEXTURE_2D, tid);
+	GLState::bindTexture(GL_TEXTURE_2D, tid);
 	// Load the actual texture data
 	// Base level is 0, number of channels is 3, and border is 0.
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
@@ -54,28 +98,28 @@ void Texture::init()
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 	// Unbind
-	glBindTexture(GL_TEXTURE_2D, 0);
+	GLState::bindTexture(GL_TEXTURE_2D, 0);
 	// Free image, since the data is now on the GPU
 	stbi_image_free(data);
+	data = nullptr;
 }
 
 void Texture::setWrapModes(GLint wrapS, GLint wrapT)
 {
 	// Must be called after init()
-	glBindTexture(GL_TEXTURE_2D, tid);
+	GLState::bindTexture(GL_TEXTURE_2D, tid);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapS);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapT);
 }
 
 void Texture::bind(GLint handle)
 {
-	glActiveTexture(GL_TEXTURE0 + unit);
-	glBindTexture(GL_TEXTURE_2D, tid);
+	GLState::bindTexture(unit, GL_TEXTURE_2D, tid);
 	glUniform1i(handle, unit);
+	RenderStats::count(RenderStats::UniformUploads);
 }
 
 void Texture::unbind()
 {
-	glActiveTexture(GL_TEXTURE0 + unit);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	GLState::bindTexture(unit, GL_TEXTURE_2D, 0);
 }
@@ -12,6 +12,10 @@ public:
 	virtual ~Texture();
 	void setFilename(const std::string &f) { filename = f; }
 	void init();
+	// Decodes the image file without touching GL, so it can run on a worker thread
+	bool load();
+	// Creates the GL texture from the decoded image, GL thread only
+	void upload();
 	void setUnit(GLint u) { unit = u; }
 	GLint getUnit() const { return unit; }
 	void bind(GLint handle);
@@ -24,6 +28,7 @@ private:
 	int height;
 	GLuint tid;
 	GLint unit;
+	unsigned char *data;
 	
 };
 
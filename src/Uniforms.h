@@ -0,0 +1,38 @@
+
+#pragma once
+
+#ifndef LAB471_UNIFORMS_H_INCLUDED
+#define LAB471_UNIFORMS_H_INCLUDED
+
+// Every uniform the renderer writes by slot. Program resolves each slot to
+// its locations when it links, so a write through Program::getUniform(slot)
+// is an array index rather than a string lookup. Add new names here.
+// Camera data (P, V, eye, time) lives in the Camera block instead.
+#define LAB471_UNIFORM_LIST(X) \
+	X(M) \
+	X(lightPos) \
+	X(Texture0) \
+	X(skybox) \
+	X(MatAmb) \
+	X(MatDif) \
+	X(MatSpec) \
+	X(shine) \
+	X(amplitude) \
+	X(wavelength) \
+	X(speed) \
+	X(direction) \
+	X(numWaves) \
+	X(waterHeight)
+
+enum class Uniform
+{
+#define LAB471_UNIFORM_ENUM(name) name,
+	LAB471_UNIFORM_LIST(LAB471_UNIFORM_ENUM)
+#undef LAB471_UNIFORM_ENUM
+	Count
+};
+
+// Shader names, indexed by Uniform
+extern const char * const UniformNames[(int) Uniform::Count];
+
+#endif // LAB471_UNIFORMS_H_INCLUDED
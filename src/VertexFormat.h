@@ -0,0 +1,106 @@
+
+#pragma once
+
+#ifndef LAB471_VERTEXFORMAT_H_INCLUDED
+#define LAB471_VERTEXFORMAT_H_INCLUDED
+
+#include <cstddef>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+
+// Which of a Shape's source arrays an attribute is filled from. The value
+// doubles as the attribute's vertex slot below.
+enum class VertexStream
+{
+	Position,
+	Normal,
+	Texcoord
+};
+
+// Attribute names and the fixed locations every shader uses for them.
+// Program binds these before linking, so a Shape's VAO works with any
+// program that follows the convention.
+const int NumVertexSlots = 4;
+const int InstanceSlot = 3; // instM is a mat4 and fills locations 3 to 6
+const char * const VertexSlotNames[NumVertexSlots] = { "vertPos", "vertNor", "vertTex", "instM" };
+const GLint VertexSlotLocations[NumVertexSlots] = { 0, 1, 2, 3 };
+
+// Packs a program's slot locations into a key; programs with equal keys can
+// share a VAO
+inline unsigned int vertexLayoutKey(const GLint locations[NumVertexSlots])
+{
+	unsigned int key = 0;
+	for (int i = 0; i < NumVertexSlots; i++)
+	{
+		key |= (unsigned int) (locations[i] & 0xff) << (8 * i);
+	}
+	return key;
+}
+
+// One float attribute inside an interleaved vertex
+struct VertexAttribute
+{
+	VertexStream stream;
+	GLint size; // number of floats
+	size_t offset; // bytes from the start of the vertex
+};
+
+// Everything needed to fill and bind an interleaved vertex buffer
+struct VertexLayout
+{
+	GLsizei stride;
+	std::vector<VertexAttribute> attributes;
+};
+
+// Describes a vertex struct V. Each vertex type specializes attributes();
+// layout() pairs it with sizeof(V) and is built once.
+template <typename V>
+struct VertexFormat
+{
+	static std::vector<VertexAttribute> attributes();
+
+	static const VertexLayout & layout()
+	{
+		static const VertexLayout layout = { (GLsizei) sizeof(V), attributes() };
+		return layout;
+	}
+};
+
+// Position and normal, for meshes without texture coordinates
+struct VertexPN
+{
+	glm::vec3 pos;
+	glm::vec3 nor;
+};
+
+// Position, normal and texture coordinate
+struct VertexPNT
+{
+	glm::vec3 pos;
+	glm::vec3 nor;
+	glm::vec2 tex;
+};
+
+template <>
+inline std::vector<VertexAttribute> VertexFormat<VertexPN>::attributes()
+{
+	return {
+		{ VertexStream::Position, 3, offsetof(VertexPN, pos) },
+		{ VertexStream::Normal, 3, offsetof(VertexPN, nor) }
+	};
+}
+
+template <>
+inline std::vector<VertexAttribute> VertexFormat<VertexPNT>::attributes()
+{
+	return {
+		{ VertexStream::Position, 3, offsetof(VertexPNT, pos) },
+		{ VertexStream::Normal, 3, offsetof(VertexPNT, nor) },
+		{ VertexStream::Texcoord, 2, offsetof(VertexPNT, tex) }
+	};
+}
+
+#endif // LAB471_VERTEXFORMAT_H_INCLUDED
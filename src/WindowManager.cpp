@@ -30,7 +30,7 @@ WindowManager::~WindowManager()
 	}
 }
 
-bool WindowManager::init(int const width, int const height)
+bool WindowManager::init(int const width, int const height, bool debugContext, bool visible)
 {
 	glfwSetErrorCallback(error_callback);
 
@@ -45,6 +45,8 @@ bool WindowManager::init(int const width, int const height)
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
+	glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, debugContext ? GL_TRUE : GL_FALSE);
+	glfwWindowHint(GLFW_VISIBLE, visible ? GL_TRUE : GL_FALSE);
 
 	// Create a windowed mode window and its OpenGL context.
 	windowHandle = glfwCreateWindow(width, height, "hello 3D", nullptr, nullptr);
@@ -67,7 +69,7 @@ bool WindowManager::init(int const width, int const height)
 	std::cout << "GLSL version: " << glGetString(GL_SHADING_LANGUAGE_VERSION) << std::endl;
 
 	// Set vsync
-	glfwSwapInterval(1);
+	setVsync(true);
 
 	glfwSetKeyCallback(windowHandle, key_callback);
 	glfwSetMouseButtonCallback(windowHandle, mouse_callback);
@@ -78,6 +80,11 @@ bool WindowManager::init(int const width, int const height)
 	return true;
 }
 
+void WindowManager::setVsync(bool enabled)
+{
+	glfwSwapInterval(enabled ? 1 : 0);
+}
+
 void WindowManager::shutdown()
 {
 	glfwDestroyWindow(windowHandle);
@@ -57,7 +57,10 @@ public:
 	WindowManager(const WindowManager&) = delete;
 	WindowManager& operator= (const WindowManager&) = delete;
 
-	bool init(int const width, int const height);
+	// A debug context makes the driver report through KHR_debug reliably.
+	// A hidden window still gets a context, for rendering offscreen.
+	bool init(int const width, int const height, bool debugContext = false, bool visible = true);
+	void setVsync(bool enabled);
 	void shutdown();
 
 	void setEventCallbacks(EventCallbacks *callbacks);
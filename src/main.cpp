@@ -7,16 +7,35 @@
 #include <iostream>
 #include <algorithm>
 #include <random>
-#include <unordered_map>
+#include <functional>
+#include <chrono>
+#include <fstream>
 #include <glad/glad.h>
 
 #include "GLSL.h"
+#include "GLState.h"
 #include "Program.h"
+#include "ProgramCache.h"
 #include "Shape.h"
+#include "MeshCache.h"
 #include "Texture.h"
 #include "MatrixStack.h"
 #include "WindowManager.h"
 #include "Particle.h"
+#include "AssetLoader.h"
+#include "CameraBuffer.h"
+#include "Frustum.h"
+#include "SpatialGrid.h"
+#include "HeightGrid.h"
+#include "FrameArena.h"
+#include "HeapCounter.h"
+#include "RenderQueue.h"
+#include "RenderStats.h"
+#include "MeshPool.h"
+#include "Framebuffer.h"
+#include "GpuProfiler.h"
+#include "Profiler.h"
+#include "Benchmark.h"
 #include "stb_image.h"
 
 #define TINYOBJLOADER_IMPLEMENTATION
@@ -31,6 +50,14 @@
 using namespace std;
 using namespace glm;
 
+// Selected with the material key
+static const Material Materials[] = {
+	{ vec3(0.19125, 0.0735, 0.0225), vec3(0.7038, 0.27048, 0.0828), vec3(0.256777, 0.137622, 0.086014), 12.8f },
+	{ vec3(0.329412, 0.223529, 0.027451), vec3(0.780392, 0.568627, 0.113725), vec3(0.992157, 0.941176, 0.807843), 27.8974f },
+	{ vec3(0.1, 0.18725, 0.1745), vec3(0.396, 0.74151, 0.69102), vec3(0.297254, 0.30829, 0.306678), 12.8f },
+	{ vec3(0.2, 0.2, 0.2), vec3(0.1, 0.35, 0.1), vec3(0.45, 0.55, 0.45), 0.25f }
+};
+
 class Application : public EventCallbacks
 {
 
@@ -57,6 +84,12 @@ public:
 	float time;
 
 	WindowManager * windowManager = nullptr;
+	AssetLoader * assetLoader = nullptr;
+	// Rendered into instead of the window when running headless
+	Framebuffer * offscreen = nullptr;
+
+	// Projection, view and eye for every program, uploaded once per frame
+	CameraBuffer camera;
 
 	// Our shader program
 	std::shared_ptr<Program> prog;
@@ -71,13 +104,14 @@ public:
 	std::shared_ptr<Shape> shack;
 	std::shared_ptr<Shape> terrain;
 	std::shared_ptr<Shape> plane;
-	std::vector<shared_ptr<Shape>> AllShapes;
+	// The dummy's parts, drawn with one call
+	std::shared_ptr<MeshPool> dummy;
 
 	// Textures
 	shared_ptr<Texture> texture0;
 	shared_ptr<Texture> texture1;
 	shared_ptr<Texture> texture2;
-	unsigned int cubeMapTexture;
+	unsigned int cubeMapTexture = 0;
 
 	// Skybox faces
 	vector<std::string> faces{
@@ -92,18 +126,35 @@ public:
 	vec3 dTrans = vec3(0);
 	float dScale = 1.0;
 
-	struct hash_pair {
-		template <class T1, class T2>
-		size_t operator()(const pair<T1, T2>& p) const
-		{
-			auto hash1 = hash<T1>{}(p.first);
-			auto hash2 = hash<T2>{}(p.second);
-			return hash1 ^ hash2;
-		}
-	};
-
 	vector<vec3> treePoints;
-	unordered_map<pair<int, int>, float, hash_pair> heightMap;
+	// Terrain surface heights, and the ones the props stand on, looked up
+	// once when the terrain arrives
+	HeightGrid heightGrid;
+	float shackHeight = 0.0f;
+	float totemHeight = 0.0f;
+
+	// Per-tree transforms and bounds in instance space, built by placeTrees()
+	// and culled every frame down to the instances actually drawn
+	vector<mat4> treeTransforms;
+	BoundingSpheres treeBounds;
+	SpatialGrid treeGrid;
+	vector<uint32_t> visibleTrees;
+
+	// Scratch memory for anything that only lives for one frame
+	FrameArena frameArena;
+
+	// Draws submitted by render(), sorted by state before they are issued
+	RenderQueue renderQueue;
+
+	// GPU time of each part of the scene
+	GpuProfiler gpuProfiler;
+	int setupPass, skyPass, terrainPass, treePass, shackPass, litPass;
+
+	// Scene placement; seeded from main so runs can be repeated exactly
+	std::mt19937 rng;
+
+	// Projection * view for the current frame, used for culling
+	mat4 viewProj;
 
 	//example data that might be useful when trying to compute bounds on multi-shape
 	vec3 gMin;
@@ -116,6 +167,13 @@ public:
 		{
 			glfwSetWindowShouldClose(window, GL_TRUE);
 		}
+		// Work handed to the driver in the last complete frame, and the
+		// GPU time of each pass
+		if (key == GLFW_KEY_I && action == GLFW_PRESS)
+		{
+			RenderStats::print(cout, RenderStats::lastFrame());
+			gpuProfiler.print(cout);
+		}
 		if (key == GLFW_KEY_M && (action == GLFW_PRESS))
 		{
 			mater = (mater + 1) % 4;
@@ -149,10 +207,10 @@ public:
 			center -= speed * cross(up, forward);
 		}
 		if (key == GLFW_KEY_Z && action == GLFW_PRESS) {
-			glPolygonMode( GL_FRONT_AND_BACK, GL_LINE );
+			GLState::polygonMode(GL_FRONT_AND_BACK, GL_LINE);
 		}
 		if (key == GLFW_KEY_Z && action == GLFW_RELEASE) {
-			glPolygonMode( GL_FRONT_AND_BACK, GL_FILL );
+			GLState::polygonMode(GL_FRONT_AND_BACK, GL_FILL);
 		}
 	}
 
@@ -209,6 +267,8 @@ public:
 
 	void init(const std::string& resourceDirectory)
 	{
+		PROFILE_SCOPE("init");
+
 		GLSL::checkVersion();
 
 		// Set background color.
@@ -216,28 +276,34 @@ public:
 		// Enable z-buffer test.
 		glEnable(GL_DEPTH_TEST);
 
+		camera.init();
+
+		// Setup covers the clear and uniform and instance uploads
+		setupPass = gpuProfiler.addPass("setup");
+		skyPass = gpuProfiler.addPass("sky");
+		terrainPass = gpuProfiler.addPass("terrain");
+		treePass = gpuProfiler.addPass("trees");
+		shackPass = gpuProfiler.addPass("shack");
+		litPass = gpuProfiler.addPass("lit");
+		gpuProfiler.init();
+		renderQueue.setProfiler(&gpuProfiler);
+
 		// Initialize the GLSL program.
 		prog = make_shared<Program>();
 		prog->setVerbose(true);
 		prog->setShaderNames(resourceDirectory + "/tex_vert.glsl", resourceDirectory + "/tex_frag0.glsl");
 		prog->init();
-		prog->addUniform("P");
-		prog->addUniform("V");
-		prog->addUniform("M");
-		prog->addUniform("Texture0");
-		prog->addUniform("eyePos");
+		// Uniforms are picked up when the program links; no addUniform needed
 		prog->addAttribute("vertPos");
 		prog->addAttribute("vertNor");
 		prog->addAttribute("vertTex");
+		prog->addAttribute("instM");
+		GLSL::vertexAttribMat4Identity(prog->getAttribute("instM"));
 
 		skyProg = make_shared<Program>();
 		skyProg->setVerbose(true);
 		skyProg->setShaderNames(resourceDirectory + "/cube_vert.glsl", resourceDirectory + "/cube_frag.glsl");
 		skyProg->init();
-		skyProg->addUniform("P");
-		skyProg->addUniform("V");
-		skyProg->addUniform("M");
-		skyProg->addUniform("skybox");
 		skyProg->addAttribute("vertPos");
 		skyProg->addAttribute("vertNor");
 
@@ -245,203 +311,283 @@ public:
 		specProg->setVerbose(true);
 		specProg->setShaderNames(resourceDirectory + "/simple_vert.glsl", resourceDirectory + "/simple_frag.glsl");
 		specProg->init();
-		specProg->addUniform("P");
-		specProg->addUniform("V");
-		specProg->addUniform("M");
-		specProg->addUniform("MatAmb");
-		specProg->addUniform("MatDif");
-		specProg->addUniform("MatSpec");
-		specProg->addUniform("shine");
-		specProg->addUniform("lightPos");
-		specProg->addUniform("eye");
 		specProg->addAttribute("vertPos");
 		specProg->addAttribute("vertNor");
 		specProg->addAttribute("vertTex");
+		// The light never moves
+		specProg->bind();
+		glUniform3f(specProg->getUniform(Uniform::lightPos), 1.0, 1.0, 1.0);
+		RenderStats::count(RenderStats::UniformUploads);
+		specProg->unbind();
 
 		/*waterProg = make_shared<Program>();
 		waterProg->setVerbose(true);
 		waterProg->setShaderNames(resourceDirectory + "/water_vert.glsl", resourceDirectory + "/water_frag.glsl");
 		waterProg->init();
-		waterProg->addUniform("P");
-		waterProg->addUniform("V");
-		waterProg->addUniform("M");
-		waterProg->addUniform("lightPos");
 		waterProg->addAttribute("vertPos");
 		waterProg->addAttribute("vertNor");*/
 	}
 
 	void initTex(const std::string& resourceDirectory)
 	{
-		texture0 = make_shared<Texture>();
-		texture0->setFilename(resourceDirectory + "/crate.jpg");
-		texture0->init();
-		texture0->setUnit(0);
-		texture0->setWrapModes(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+		PROFILE_SCOPE("initTex");
+
+		loadTexture(resourceDirectory + "/crate.jpg", 0, GL_CLAMP_TO_EDGE,
+			[this](shared_ptr<Texture> texture) { texture0 = texture; });
+		loadTexture(resourceDirectory + "/shacktex.jpg", 1, GL_CLAMP_TO_EDGE,
+			[this](shared_ptr<Texture> texture) { texture1 = texture; });
+		loadTexture(resourceDirectory + "/grass.jpg", 2, GL_REPEAT,
+			[this](shared_ptr<Texture> texture) { texture2 = texture; });
+	}
 
-		texture1 = make_shared<Texture>();
-		texture1->setFilename(resourceDirectory + "/shacktex.jpg");
-		texture1->init();
-		texture1->setUnit(1);
-		texture1->setWrapModes(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+	// Decodes an image on a loader thread, then uploads it and hands it to
+	// ready() on the GL thread
+	void loadTexture(const string &path, GLint unit, GLint wrapMode, function<void(shared_ptr<Texture>)> ready)
+	{
+		auto texture = make_shared<Texture>();
+		texture->setFilename(path);
+		texture->setUnit(unit);
 
-		texture2 = make_shared<Texture>();
-		texture2->setFilename(resourceDirectory + "/grass.jpg");
-		texture2->init();
-		texture2->setUnit(2);
-		texture2->setWrapModes(GL_REPEAT, GL_REPEAT);
+		assetLoader->enqueue(
+			[texture]() { texture->load(); },
+			[texture, wrapMode, ready]()
+			{
+				texture->upload();
+				texture->setWrapModes(wrapMode, wrapMode);
+				ready(texture);
+			});
+	}
+
+	// Parses an OBJ (through its mesh cache) and builds the Shape on a loader
+	// thread, then uploads it and hands it to ready() on the GL thread.
+	// process, if given, also runs on the loader thread before measure().
+	void loadShape(const string &path, bool parallelParse, function<void(shared_ptr<Shape>)> ready,
+		function<void(Shape &, const MeshCache::Mesh &)> process = nullptr)
+	{
+		auto shape = make_shared<Shape>();
+		auto loaded = make_shared<bool>(false);
+
+		assetLoader->enqueue(
+			[path, parallelParse, shape, loaded, process]()
+			{
+				// The shape reads the mapped file until it is uploaded
+				auto meshCache = make_shared<MeshCache>();
+				string errStr;
+				if (!meshCache->load(path, errStr, parallelParse))
+				{
+					cerr << errStr << endl;
+					return;
+				}
+				shape->createShape(meshCache, meshCache->getMeshes()[0]);
+				if (process)
+				{
+					process(*shape, meshCache->getMeshes()[0]);
+				}
+				shape->measure();
+				shape->prepare();
+				*loaded = true;
+			},
+			[shape, loaded, ready]()
+			{
+				if (*loaded)
+				{
+					shape->init();
+					ready(shape);
+				}
+			});
 	}
 
 	void initGeom(const std::string& resourceDirectory)
 	{
+		PROFILE_SCOPE("initGeom");
 
-		//EXAMPLE set up to read one shape from one obj file - convert to read several
-		// Initialize mesh
-		// Load geometry
- 		// Some obj files contain material information.We'll ignore them for this assignment.
- 		vector<tinyobj::shape_t> TOshapes;
- 		vector<tinyobj::material_t> objMaterials;
- 		string errStr;
+		// Everything here is loaded in the background; objects show up in
+		// render() as their uploads complete.
 		genRandPoints(vec2(-6, -6), vec2(-80, -80), vec2(80, 80), 12, 12);
 
-		bool rc = tinyobj::LoadObj(TOshapes, objMaterials, errStr,
-			(resourceDirectory + "/dummy.obj").c_str());
+		loadDummy(resourceDirectory + "/dummy.obj");
 
-		if (!rc)
-		{
-			cerr << errStr << endl;
-		}
-		else
-		{
-			for (size_t i = 0; i < TOshapes.size(); i++)
+		loadShape(resourceDirectory + "/cube.obj", false,
+			[this](shared_ptr<Shape> shape) { cube = shape; });
+
+		loadShape(resourceDirectory + "/tree.obj", true,
+			[this](shared_ptr<Shape> shape) { tree = shape; placeTrees(); });
+
+		loadShape(resourceDirectory + "/totem.obj", false,
+			[this](shared_ptr<Shape> shape) { totem = shape; });
+
+		loadShape(resourceDirectory + "/shack.obj", false,
+			[this](shared_ptr<Shape> shape) { shack = shape; });
+
+		loadShape(resourceDirectory + "/plane.obj", false,
+			[this](shared_ptr<Shape> shape) { plane = shape; });
+
+		// Heights are built on the loader thread and swapped in with the terrain
+		auto heights = make_shared<HeightGrid>();
+		loadShape(resourceDirectory + "/terrain.obj", true,
+			[this, heights](shared_ptr<Shape> shape)
 			{
-				shared_ptr<Shape> curMesh = make_shared<Shape>();;
-				curMesh->createShape(TOshapes[i]);
-				curMesh->measure();
-				curMesh->init();
-				AllShapes.push_back(curMesh);
-			}
+				heightGrid = std::move(*heights);
+				shackHeight = heightGrid.sample(0, 0);
+				totemHeight = heightGrid.sample(-3, -3);
+				terrain = shape;
+				placeTrees();
+			},
+			[heights](Shape &shape, const MeshCache::Mesh &mesh)
+			{
+				shape.tileCoords(8.0);
+				heights->build(mesh.positions, mesh.numVertices, mesh.indices, mesh.numIndices, 0.5f);
+			});
 
-			float dMax = AllShapes[0]->max.x;
-			float dMin = AllShapes[0]->min.x;
-			vec3 dvMax = AllShapes[0]->max;
-			vec3 dvMin = AllShapes[0]->min;
-			for (int i = 0; i < AllShapes.size(); i++) {
-				if (AllShapes[i]->max.x > AllShapes[i]->max.y && AllShapes[i]->max.x > AllShapes[i]->max.z)
+		loadSky(resourceDirectory + "/cracks/", faces);
+	}
+
+	// The multi-part dummy model packed into one mesh pool, plus the scale
+	// and offset that fit it in a unit box
+	void loadDummy(const string &path)
+	{
+		auto pool = make_shared<MeshPool>();
+		auto fit = make_shared<pair<float, vec3>>(1.0f, vec3(0));
+
+		assetLoader->enqueue(
+			[path, pool, fit]()
+			{
+				auto meshCache = make_shared<MeshCache>();
+				string errStr;
+				if (!meshCache->load(path, errStr))
 				{
-					if (AllShapes[i]->max.x > dMax) {
-						dMax = AllShapes[i]->max.x;
-						dvMax = AllShapes[i]->max;
-					}
-					if (AllShapes[i]->min.x < dMin) {
-						dMin = AllShapes[i]->min.x;
-						dvMin = AllShapes[i]->min;
-					}
+					cerr << errStr << endl;
+					return;
 				}
-				else if (AllShapes[i]->max.y > AllShapes[i]->max.x && AllShapes[i]->max.y > AllShapes[i]->max.z)
+
+				vector<shared_ptr<Shape>> shapes;
+				const vector<MeshCache::Mesh> &meshes = meshCache->getMeshes();
+				for (size_t i = 0; i < meshes.size(); i++)
 				{
-					if (AllShapes[i]->max.y > dMax) {
-						dMax = AllShapes[i]->max.y;
-						dvMax = AllShapes[i]->max;
-					}
-					if (AllShapes[i]->min.y < dMin) {
-						dMin = AllShapes[i]->min.y;
-						dvMin = AllShapes[i]->min;
-					}
+					shared_ptr<Shape> curMesh = make_shared<Shape>();
+					curMesh->createShape(meshCache, meshes[i]);
+					curMesh->measure();
+					curMesh->prepare();
+					pool->add(*curMesh);
+					shapes.push_back(curMesh);
 				}
-				else
+				if (!shapes.empty())
 				{
-					if (AllShapes[i]->max.z > dMax) {
-						dMax = AllShapes[i]->max.z;
-						dvMax = AllShapes[i]->max;
-					}
-					if (AllShapes[i]->min.z < dMin) {
-						dMin = AllShapes[i]->min.z;
-						dvMin = AllShapes[i]->min;
-					}
+					*fit = fitDummy(shapes);
 				}
-			}
-			dScale = 2.0 / (dMax - dMin);
-			dTrans = dMin + 0.5f * (dvMax - dvMin);
-		}
-		
-		//load in the mesh and make the shape(s)
-		rc = tinyobj::LoadObj(TOshapes, objMaterials, errStr, (resourceDirectory + "/cube.obj").c_str());
-		if (!rc) {
-			cerr << errStr << endl;
-		}
-		else {
-			cube = make_shared<Shape>();
-			cube->createShape(TOshapes[0]);
-			cube->measure();
-			cube->init();
-		}
+			},
+			[this, pool, fit]()
+			{
+				pool->init();
+				dScale = fit->first;
+				dTrans = fit->second;
+				dummy = pool;
+			});
+	}
 
-		rc = tinyobj::LoadObj(TOshapes, objMaterials, errStr, (resourceDirectory + "/tree.obj").c_str());
-		if (!rc) {
-			cerr << errStr << endl;
-		}
-		else {
-			tree = make_shared<Shape>();
-			tree->createShape(TOshapes[0]);
-			tree->measure();
-			tree->init();
+	static pair<float, vec3> fitDummy(const vector<shared_ptr<Shape>> &AllShapes)
+	{
+		float dMax = AllShapes[0]->max.x;
+		float dMin = AllShapes[0]->min.x;
+		vec3 dvMax = AllShapes[0]->max;
+		vec3 dvMin = AllShapes[0]->min;
+		for (size_t i = 0; i < AllShapes.size(); i++) {
+			if (AllShapes[i]->max.x > AllShapes[i]->max.y && AllShapes[i]->max.x > AllShapes[i]->max.z)
+			{
+				if (AllShapes[i]->max.x > dMax) {
+					dMax = AllShapes[i]->max.x;
+					dvMax = AllShapes[i]->max;
+				}
+				if (AllShapes[i]->min.x < dMin) {
+					dMin = AllShapes[i]->min.x;
+					dvMin = AllShapes[i]->min;
+				}
+			}
+			else if (AllShapes[i]->max.y > AllShapes[i]->max.x && AllShapes[i]->max.y > AllShapes[i]->max.z)
+			{
+				if (AllShapes[i]->max.y > dMax) {
+					dMax = AllShapes[i]->max.y;
+					dvMax = AllShapes[i]->max;
+				}
+				if (AllShapes[i]->min.y < dMin) {
+					dMin = AllShapes[i]->min.y;
+					dvMin = AllShapes[i]->min;
+				}
+			}
+			else
+			{
+				if (AllShapes[i]->max.z > dMax) {
+					dMax = AllShapes[i]->max.z;
+					dvMax = AllShapes[i]->max;
+				}
+				if (AllShapes[i]->min.z < dMin) {
+					dMin = AllShapes[i]->min.z;
+					dvMin = AllShapes[i]->min;
+				}
+			}
 		}
+		float dScale = 2.0 / (dMax - dMin);
+		vec3 dTrans = dMin + 0.5f * (dvMax - dvMin);
+		return make_pair(dScale, dTrans);
+	}
 
-		rc = tinyobj::LoadObj(TOshapes, objMaterials, errStr, (resourceDirectory + "/totem.obj").c_str());
-		if (!rc) {
-			cerr << errStr << endl;
-		}
-		else {
-			totem = make_shared<Shape>();
-			totem->createShape(TOshapes[0]);
-			totem->measure();
-			totem->init();
+	// Bake each tree's translation into the instance buffer once, so the
+	// whole forest is a single instanced draw
+	void placeTrees()
+	{
+		if (!tree || !terrain)
+		{
+			return;
 		}
 
-		rc = tinyobj::LoadObj(TOshapes, objMaterials, errStr, (resourceDirectory + "/shack.obj").c_str());
-		if (!rc) {
-			cerr << errStr << endl;
-		}
-		else {
-			shack = make_shared<Shape>();
-			shack->createShape(TOshapes[0]);
-			shack->measure();
-			shack->init();
-		}
+		// A sphere around the tree's bounding box, moved to each placement
+		const vec3 center = 0.5f * (tree->min + tree->max);
+		const float radius = 0.5f * length(tree->max - tree->min);
 
-		rc = tinyobj::LoadObj(TOshapes, objMaterials, errStr, (resourceDirectory + "/plane.obj").c_str());
-		if (!rc) {
-			cerr << errStr << endl;
-		}
-		else {
-			plane = make_shared<Shape>();
-			plane->createShape(TOshapes[0]);
-			plane->measure();
-			plane->init();
+		// Ground height under every tree in one batch
+		const size_t count = treePoints.size();
+		vector<float> xs(count), zs(count), heights(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			xs[i] = treePoints[i].x;
+			zs[i] = treePoints[i].z;
 		}
+		heightGrid.sample(xs.data(), zs.data(), heights.data(), count);
 
-		rc = tinyobj::LoadObj(TOshapes, objMaterials, errStr, (resourceDirectory + "/terrain.obj").c_str());
-		if (!rc) {
-			cerr << errStr << endl;
-		}
-		else {
-			terrain = make_shared<Shape>();
-			terrain->createShape(TOshapes[0]);
-			terrain->tileCoords(8.0);
-			terrain->measure();
-			terrain->init();
-			getHeights(TOshapes[0].mesh.positions);
+		treeTransforms.clear();
+		treeTransforms.reserve(count);
+		treeBounds.clear();
+		treeBounds.reserve(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			vec3 p = treePoints[i];
+			vec3 offset = vec3(p.x, heights[i] - 3.5, p.z);
+			treeTransforms.push_back(translate(mat4(1.0f), offset));
+			treeBounds.push_back(center + offset, radius);
 		}
-
-		cubeMapTexture = createSky(resourceDirectory + "/cracks/", faces);
+		treeGrid.build(treeBounds);
+		tree->setInstances(treeTransforms);
 	}
 
-	void getHeights(vector<float> positions)
+	// Uploads only the trees inside the frustum of viewProj * M
+	void cullTrees(const mat4 &M)
 	{
-		for (size_t i = 0; i < positions.size(); i+=3)
+		Frustum frustum(viewProj * M);
+		treeGrid.queryFrustum(frustum, visibleTrees);
+
+		ArenaVector<mat4> visibleTransforms{ ArenaAllocator<mat4>(&frameArena) };
+		visibleTransforms.reserve(visibleTrees.size());
+		for (size_t i = 0; i < visibleTrees.size(); i++)
 		{
-			heightMap[make_pair((int)positions[i], (int)positions[i+2])] = positions[i+1];
+			visibleTransforms.push_back(treeTransforms[visibleTrees[i]]);
 		}
+		tree->setInstances(visibleTransforms.data(), visibleTransforms.size());
+	}
+
+	// Whether shape's bounding box, placed by M, is at least partly on screen
+	bool isVisible(const shared_ptr<Shape> &shape, const mat4 &M) const
+	{
+		return Frustum(viewProj * M).intersectsBox(shape->min, shape->max);
 	}
 
 	double trunc_decs(double value, std::size_t digits_after_decimal = 0)
@@ -460,7 +606,8 @@ public:
 
 	float randomFloat(float mn, float mx)
 	{
-		return ((float(rand()) / float(RAND_MAX)) * (mx - mn)) + mn;
+		// Scaled by hand: the standard distributions differ between libraries
+		return (float(rng()) / float(rng.max())) * (mx - mn) + mn;
 	}
 
 	void genRandPoints(vec2 point, vec2 bound1, vec2 bound2, float width, float height)
@@ -486,7 +633,7 @@ public:
 
 		for (size_t i = 0; i < 1000; i++)
 		{
-			int r = rand() % boxes.size();
+			int r = rng() % boxes.size();
 			vector<float> box = boxes[r];
 			float x = randomFloat(box[0], box[2]);
 			float z = randomFloat(box[1], box[3]);
@@ -495,56 +642,52 @@ public:
 		}
 	}
 
-	void setModel(std::shared_ptr<Program> prog, std::shared_ptr<MatrixStack>M) {
-		glUniformMatrix4fv(prog->getUniform("M"), 1, GL_FALSE, value_ptr(M->topMatrix()));
-    }
+	static TextureBinding textureBinding(const Texture &texture)
+	{
+		return { GL_TEXTURE_2D, (GLuint) texture.getID(), texture.getUnit(), Uniform::Texture0 };
+	}
 
-	void setMaterial(std::shared_ptr<Program> prog, int i) {
-		switch (i) {
-		case 0:
-			glUniform3f(prog->getUniform("MatAmb"), 0.19125, 0.0735, 0.0225);
-			glUniform3f(prog->getUniform("MatDif"), 0.7038, 0.27048, 0.0828);
-			glUniform3f(prog->getUniform("MatSpec"), 0.256777, 0.137622, 0.086014);
-			glUniform1f(prog->getUniform("shine"), 12.8);
-			break;
-		case 1:
-			glUniform3f(prog->getUniform("MatAmb"), 0.329412, 0.223529, 0.027451);
-			glUniform3f(prog->getUniform("MatDif"), 0.780392, 0.568627, 0.113725);
-			glUniform3f(prog->getUniform("MatSpec"), 0.992157, 0.941176, 0.807843);
-			glUniform1f(prog->getUniform("shine"), 27.8974);
-			break;
-		case 2:
-			glUniform3f(prog->getUniform("MatAmb"), 0.1, 0.18725, 0.1745);
-			glUniform3f(prog->getUniform("MatDif"), 0.396, 0.74151, 0.69102);
-			glUniform3f(prog->getUniform("MatSpec"), 0.297254, 0.30829, 0.306678);
-			glUniform1f(prog->getUniform("shine"), 12.8);
-			break;
-		case 3:
-			glUniform3f(prog->getUniform("MatAmb"), 0.2, 0.2, 0.2);
-			glUniform3f(prog->getUniform("MatDif"), 0.1, 0.35, 0.1);
-			glUniform3f(prog->getUniform("MatSpec"), 0.45, 0.55, 0.45);
-			glUniform1f(prog->getUniform("shine"), 0.25);
-			break;
-		}
+	struct SkyFace
+	{
+		unsigned char *data;
+		int width, height, nrChannels;
+	};
+
+	// Decodes the six faces on a loader thread, then builds the cube map
+	void loadSky(const string &dir, const vector<string> &faces)
+	{
+		auto images = make_shared<vector<SkyFace>>(faces.size());
+
+		assetLoader->enqueue(
+			[dir, faces, images]()
+			{
+				for (size_t i = 0; i < faces.size(); i++)
+				{
+					SkyFace &face = (*images)[i];
+					face.data = stbi_load((dir+faces[i]).c_str(), &face.width, &face.height, &face.nrChannels, 0);
+					if (!face.data)
+					{
+						cout << "failed to load: " << (dir+faces[i]).c_str() << endl;
+					}
+				}
+			},
+			[this, images]()
+			{
+				cubeMapTexture = createSky(*images);
+			});
 	}
 
-	unsigned int createSky(string dir, vector<string> faces)
+	unsigned int createSky(const vector<SkyFace> &images)
 	{
 		unsigned int textureID;
 		glGenTextures(1, &textureID);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-		int width, height, nrChannels;
-		stbi_set_flip_vertically_on_load(false);
-		for (GLuint i = 0; i < faces.size(); i++)
+		GLState::bindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+		for (GLuint i = 0; i < images.size(); i++)
 		{
-			unsigned char* data = stbi_load((dir+faces[i]).c_str(), &width, &height, &nrChannels, 0);
-			if (data)
-			{
-				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-			}
-			else
+			if (images[i].data)
 			{
-				cout << "failed to load: " << (dir+faces[i]).c_str() << endl;
+				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, images[i].width, images[i].height, 0, GL_RGB, GL_UNSIGNED_BYTE, images[i].data);
+				stbi_image_free(images[i].data);
 			}
 		}
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -557,11 +700,28 @@ public:
 	}
 	
 	void render() {
+		PROFILE_SCOPE("render");
+
+		// Nothing from the previous frame is still in use
+		frameArena.reset();
+
 		// Get current frame buffer size.
 		int width, height;
-		glfwGetFramebufferSize(windowManager->getHandle(), &width, &height);
+		if (offscreen)
+		{
+			offscreen->bind();
+			width = offscreen->getWidth();
+			height = offscreen->getHeight();
+		}
+		else
+		{
+			glfwGetFramebufferSize(windowManager->getHandle(), &width, &height);
+		}
 		glViewport(0, 0, width, height);
 
+		gpuProfiler.beginFrame();
+		gpuProfiler.begin(setupPass);
+
 		// Clear framebuffer.
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -576,16 +736,12 @@ public:
 		center = eye + vec3(x, y, z);
 		forward = normalize(center - eye);
 
-		shared_ptr<Shape> leftArm = AllShapes[10];
-		shared_ptr<Shape> leftElbow = AllShapes[9];
-		shared_ptr<Shape> leftFore = AllShapes[8];
-		shared_ptr<Shape> leftWrist = AllShapes[7];
-		shared_ptr<Shape> leftHand = AllShapes[6];
-
 		// Create the matrix stacks - please leave these alone for now
-		auto Projection = make_shared<MatrixStack>();
+		// They only live for this frame, so they come from the frame arena
+		ArenaAllocator<MatrixStack> stackAllocator(&frameArena);
+		auto Projection = allocate_shared<MatrixStack>(stackAllocator);
 		//auto View = make_shared<MatrixStack>();
-		auto Model = make_shared<MatrixStack>();
+		auto Model = allocate_shared<MatrixStack>(stackAllocator);
 
 		// Apply perspective projection.
 		Projection->pushMatrix();
@@ -595,177 +751,147 @@ public:
 		//View->pushMatrix();
 		//View->loadIdentity();
 
-		// Draw skybox
-		skyProg->bind();
-		glUniformMatrix4fv(skyProg->getUniform("P"), 1, GL_FALSE, value_ptr(Projection->topMatrix()));
-		glDepthFunc(GL_LEQUAL);
-		glUniformMatrix4fv(skyProg->getUniform("V"), 1, GL_FALSE, value_ptr(lookAt(eye, center, up)));
+		// Shared by every program through the Camera uniform block
+		const mat4 View = lookAt(eye, center, up);
+		camera.update(Projection->topMatrix(), View, eye, time);
+		viewProj = Projection->topMatrix() * View;
 
-		Model->pushMatrix();
-			Model->loadIdentity();
-			Model->translate(eye);
-			Model->scale(vec3(110, 110, 110));
+		// Every draw goes through the queue, which orders them by state
+		renderQueue.begin(eye);
 
-			glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMapTexture);
-			setModel(skyProg, Model);
-			cube->draw(skyProg);
-		Model->popMatrix();
+		// Skybox; objects still loading in the background are skipped
+		if (cube && cubeMapTexture)
+		{
+			Model->pushMatrix();
+				Model->loadIdentity();
+				Model->translate(eye);
+				Model->scale(vec3(110, 110, 110));
 
-		glDepthFunc(GL_LESS);
-		skyProg->unbind();
-		
-		prog->bind();
-		glUniformMatrix4fv(prog->getUniform("P"), 1, GL_FALSE, value_ptr(Projection->topMatrix()));
-		glUniformMatrix4fv(prog->getUniform("V"), 1, GL_FALSE, value_ptr(lookAt(eye, center, up)));
-		glUniform3f(prog->getUniform("eyePos"), eye.x, eye.y, eye.z);
-		//setMaterial(prog, mater);
+				const TextureBinding sky = { GL_TEXTURE_CUBE_MAP, cubeMapTexture, 0, Uniform::skybox };
+				renderQueue.setPass(skyPass);
+				renderQueue.submit(RenderQueue::Sky, skyProg, &sky, nullptr, cube.get(), Model->topMatrix());
+			Model->popMatrix();
+		}
 
 		// draw stuff
 		Model->pushMatrix();
 			Model->loadIdentity();
 
 			// draw ground
-			Model->pushMatrix();
-				Model->translate(vec3(0, -3, 0));
-				texture2->bind(prog->getUniform("Texture0"));
-				//Model->translate(vec3(-10, -4.5, 0));
-				//Model->scale(vec3(500.0, 500.0, 500.0));
-				//setMaterial(prog, 2);
-				setModel(prog, Model);
-				terrain->draw(prog);
-				texture2->unbind();
-			Model->popMatrix();
+			if (terrain && texture2)
+			{
+				Model->pushMatrix();
+					Model->translate(vec3(0, -3, 0));
+					if (isVisible(terrain, Model->topMatrix()))
+					{
+						//Model->translate(vec3(-10, -4.5, 0));
+						//Model->scale(vec3(500.0, 500.0, 500.0));
+						const TextureBinding grass = textureBinding(*texture2);
+						renderQueue.setPass(terrainPass);
+						renderQueue.submit(RenderQueue::Opaque, prog, &grass, nullptr, terrain.get(), Model->topMatrix());
+					}
+				Model->popMatrix();
+			}
 
 			Model->pushMatrix();
 				//Model->translate(vec3(5.0, 0.0, -20.0));
 
 				// draw trees
-				Model->pushMatrix();
-					Model->scale(vec3(0.6, 0.6, 0.6));
-					//setMaterial(prog, 0);
-					texture0->bind(prog->getUniform("Texture0"));
-
-					for (size_t i = 0; i < 1000; i++)
-					{
-						Model->pushMatrix();
-							vec3 p = treePoints[i];
-							Model->translate(vec3(p.x, heightMap[make_pair((int)p.x, (int)p.z)] - 3.5, p.z));
-							setModel(prog, Model);
-							tree->draw(prog);
-						Model->popMatrix();
-					}
+				if (tree && texture0)
+				{
+					Model->pushMatrix();
+						Model->scale(vec3(0.6, 0.6, 0.6));
+						cullTrees(Model->topMatrix());
 
-					texture0->unbind();
-				Model->popMatrix();
+						const TextureBinding bark = textureBinding(*texture0);
+						renderQueue.setPass(treePass);
+						renderQueue.submit(RenderQueue::Opaque, prog, &bark, nullptr, tree.get(), Model->topMatrix(), true);
+					Model->popMatrix();
+				}
 
 				// draw shack
-				Model->pushMatrix();
-					Model->translate(vec3(0, heightMap[make_pair(0, 0)] - 3, 0));
-					Model->rotate(PI / 2.0, vec3(0, 1, 0));
-					//Model->rotate(0.174533, vec3(0, 0, 1));
-					Model->scale(vec3(0.03, 0.03, 0.03));
-					//setMaterial(prog, 1);
-					texture1->bind(prog->getUniform("Texture0"));
-					setModel(prog, Model);
-					shack->draw(prog);
-					texture1->unbind();
-				Model->popMatrix();
+				if (shack && texture1)
+				{
+					Model->pushMatrix();
+						Model->translate(vec3(0, shackHeight - 3, 0));
+						Model->rotate(PI / 2.0, vec3(0, 1, 0));
+						//Model->rotate(0.174533, vec3(0, 0, 1));
+						Model->scale(vec3(0.03, 0.03, 0.03));
+						if (isVisible(shack, Model->topMatrix()))
+						{
+							const TextureBinding wood = textureBinding(*texture1);
+							renderQueue.setPass(shackPass);
+							renderQueue.submit(RenderQueue::Opaque, prog, &wood, nullptr, shack.get(), Model->topMatrix());
+						}
+					Model->popMatrix();
+				}
 			Model->popMatrix();
-		Model->popMatrix();
 
-		prog->unbind();
+			// The lit objects all share the selected material
+			const Material *material = &Materials[mater];
+			renderQueue.setPass(litPass);
 
-		specProg->bind();
-		glUniformMatrix4fv(specProg->getUniform("P"), 1, GL_FALSE, value_ptr(Projection->topMatrix()));
-		glUniformMatrix4fv(specProg->getUniform("V"), 1, GL_FALSE, value_ptr(lookAt(eye, center, up)));
-		glUniform3f(specProg->getUniform("lightPos"), 1.0, 1.0, 1.0);
-		glUniform3f(specProg->getUniform("eye"), eye.x, eye.y, eye.z);
-
-		Model->pushMatrix();
-			Model->loadIdentity();
-
-			// draw ground
-			Model->pushMatrix();
-				Model->translate(vec3(-5, heightMap[make_pair(-3, -3)] - 3, -5));
-				setModel(specProg, Model);
-				setMaterial(specProg, mater);
-				totem->draw(specProg);
-			Model->popMatrix();
-
-			for (int i = 0; i < AllShapes.size(); i++) {
+			// draw totem
+			if (totem)
+			{
 				Model->pushMatrix();
-					Model->translate(vec3(0, 0.f, -5));
-					Model->rotate(radians(-90.f), vec3(1, 0, 0));
-					Model->rotate(radians(-90.f), vec3(0, 0, 1));
-					Model->scale(dScale);
-					Model->translate(-1.0f*dTrans);
-					setModel(specProg, Model);
-					AllShapes[i]->draw(specProg);
+					Model->translate(vec3(-5, totemHeight - 3, -5));
+					if (isVisible(totem, Model->topMatrix()))
+					{
+						renderQueue.submit(RenderQueue::Opaque, specProg, nullptr, material, totem.get(), Model->topMatrix());
+					}
 				Model->popMatrix();
 			}
 
-			/*Model->pushMatrix();
-				Model->translate(vec3(0, 0.f, -5));
-				Model->rotate(radians(-90.f), vec3(1, 0, 0));
-				Model->rotate(radians(-90.f), vec3(0, 0, 1));
-				Model->scale(dScale);
-				Model->translate(-1.0f*dTrans);
-				Model->rotate(sinf(time), vec3(0, 0, 1));
-				setModel(specProg, Model);
-				leftArm->draw(specProg);
-				leftElbow->draw(specProg);
-				Model->pushMatrix();
-					setModel(specProg, Model);
-					leftFore->draw(specProg);
-					Model->pushMatrix();
-						setModel(specProg, Model);
-						leftWrist->draw(specProg);
-						Model->pushMatrix();
-							setModel(specProg, Model);
-							leftHand->draw(specProg);
-						Model->popMatrix();
-					Model->popMatrix();
-				Model->popMatrix();
-			Model->popMatrix();
-
-			for (int i = 11; i < AllShapes.size(); i++) {
+			// Every visible part of the dummy in one multi-draw
+			if (dummy)
+			{
 				Model->pushMatrix();
 					Model->translate(vec3(0, 0.f, -5));
 					Model->rotate(radians(-90.f), vec3(1, 0, 0));
 					Model->rotate(radians(-90.f), vec3(0, 0, 1));
 					Model->scale(dScale);
 					Model->translate(-1.0f*dTrans);
-					setModel(specProg, Model);
-					AllShapes[i]->draw(specProg);
+
+					const Frustum frustum(viewProj * Model->topMatrix());
+					dummy->clearDraws();
+					for (size_t i = 0; i < dummy->size(); i++)
+					{
+						if (frustum.intersectsBox(dummy->getMin(i), dummy->getMax(i)))
+						{
+							dummy->addDraw(i);
+						}
+					}
+					if (dummy->numDraws() > 0)
+					{
+						renderQueue.submit(RenderQueue::Opaque, specProg, nullptr, material, dummy.get(), Model->topMatrix());
+					}
 				Model->popMatrix();
-			}*/
+			}
 
 		Model->popMatrix();
-		specProg->unbind();
+
+		renderQueue.execute();
+		gpuProfiler.endFrame();
 
 		//waterProg->bind();
-		//
-		//glUniformMatrix4fv(waterProg->getUniform("P"), 1, GL_FALSE, value_ptr(Projection->topMatrix()));
-		//glUniformMatrix4fv(waterProg->getUniform("V"), 1, GL_FALSE, value_ptr(lookAt(eye, center, up)));
-		//glUniform3f(waterProg->getUniform("eyePos"), eye.x, eye.y, eye.z);
 
 		//for (int i = 0; i < 4; ++i) {
 		//	float amplitude = 0.5f / (i + 1);
-		//	glUniform1f(waterProg->getUniform("amplitude[" + to_string(i) + "]"), amplitude);
+		//	glUniform1f(waterProg->getUniform(Uniform::amplitude, i), amplitude);
 
 		//	float wavelength = 8 * 3.14159 / (i + 1);
-		//	glUniform1f(waterProg->getUniform("wavelength[" + to_string(i) + "]"), wavelength);
+		//	glUniform1f(waterProg->getUniform(Uniform::wavelength, i), wavelength);
 
 		//	float speed = 1.0f + 2*i;
-		//	glUniform1f(waterProg->getUniform("speed[" + to_string(i) + "]"), speed);
+		//	glUniform1f(waterProg->getUniform(Uniform::speed, i), speed);
 
 		//	float angle = randomFloat(-3.14159/3, 3.14159/3);
-		//	glUniform2f(waterProg->getUniform("direction[" + to_string(i) + "]"), cos(angle), sin(angle));
+		//	glUniform2f(waterProg->getUniform(Uniform::direction, i), cos(angle), sin(angle));
 		//}
 
-		//glUniform1i(waterProg->getUniform("numWaves"), 4);
-		//glUniform1f(waterProg->getUniform("waterHeight"), 10);
-		//glUniform1f(waterProg->getUniform("time"), frames / 60.0);
+		//glUniform1i(waterProg->getUniform(Uniform::numWaves), 4);
+		//glUniform1f(waterProg->getUniform(Uniform::waterHeight), 10);
 
 		//// draw stuff
 		//Model->pushMatrix();
@@ -789,46 +915,317 @@ public:
 
 int main(int argc, char *argv[])
 {
+	PROFILE_THREAD("main");
+
 	// Where the resources are loaded from
 	std::string resourceDir = "../resources";
 
-	if (argc >= 2)
+	// Chrome trace of the PROFILE_SCOPEs, written on exit
+	string traceFile;
+
+	// How GL errors are reported. The callback costs nothing per call in
+	// the app, but a debug context makes the driver validate every call, so
+	// measured runs default to off.
+	GLSL::DebugLevel debugLevel = GLSL::DebugLevel::Callback;
+	bool debugLevelGiven = false;
+
+	// Headless runs render a fixed number of frames into an offscreen
+	// framebuffer in a hidden window, without vsync
+	bool headless = false;
+	int width = 640;
+	int height = 480;
+	long frameCount = 600;
+	string framePrefix;
+
+	// Benchmark runs fly the camera along a scripted path with vsync off
+	// and write frame time statistics to a JSON file. The benchmark build
+	// runs one by default.
+#ifdef LAB471_BENCHMARK
+	bool benchmark = true;
+#else
+	bool benchmark = false;
+#endif
+	string cameraPathFile;
+	string jsonFile = "benchmark.json";
+	long warmupFrames = 60;
+	// Seeds every random number generator
+	unsigned int seed = 471;
+
+	for (int i = 1; i < argc; i++)
 	{
-		resourceDir = argv[1];
+		const string arg = argv[i];
+		const size_t equals = arg.find('=');
+		const string flag = arg.substr(0, equals);
+		const string value = equals == string::npos ? "" : arg.substr(equals + 1);
+
+		if (flag == "--gl-debug")
+		{
+			debugLevelGiven = true;
+			if (!GLSL::parseDebugLevel(value, debugLevel))
+			{
+				cerr << "Unknown " << arg << ", expected off, callback or sync" << endl;
+				return EXIT_FAILURE;
+			}
+		}
+		else if (flag == "--headless")
+		{
+			headless = true;
+		}
+		else if (flag == "--size")
+		{
+			if (sscanf(value.c_str(), "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0)
+			{
+				cerr << "Unknown " << arg << ", expected WIDTHxHEIGHT" << endl;
+				return EXIT_FAILURE;
+			}
+		}
+		else if (flag == "--frames")
+		{
+			char *end = nullptr;
+			frameCount = strtol(value.c_str(), &end, 10);
+			if (value.empty() || *end != '\0' || frameCount <= 0)
+			{
+				cerr << "Unknown " << arg << ", expected N > 0" << endl;
+				return EXIT_FAILURE;
+			}
+		}
+		else if (flag == "--write-frames")
+		{
+			// Each frame goes to <prefix>NNNN.png
+			framePrefix = value;
+		}
+		else if (flag == "--benchmark")
+		{
+			benchmark = true;
+			cameraPathFile = value;
+		}
+		else if (flag == "--json")
+		{
+			jsonFile = value;
+		}
+		else if (flag == "--warmup")
+		{
+			warmupFrames = max(atol(value.c_str()), 0L);
+		}
+		else if (flag == "--seed")
+		{
+			seed = (unsigned int) strtoul(value.c_str(), nullptr, 10);
+		}
+		else if (flag == "--no-shader-cache")
+		{
+			ProgramCache::setEnabled(false);
+		}
+		else if (flag == "--trace")
+		{
+#ifndef LAB471_PROFILE
+			cerr << "--trace needs a build with LAB471_PROFILE; no scopes will be recorded" << endl;
+#endif
+			traceFile = value;
+		}
+		else if (arg.compare(0, 2, "--") == 0)
+		{
+			cerr << "Unknown option " << arg << endl;
+			cerr << "Usage: " << argv[0] << " [resourceDir] [--gl-debug=off|callback|sync]"
+				<< " [--headless [--size=WxH] [--frames=N] [--write-frames=prefix]]"
+				<< " [--benchmark[=cameraPath] [--warmup=N] [--json=file]] [--seed=N] [--trace=file]"
+				<< " [--no-shader-cache]" << endl;
+			return EXIT_FAILURE;
+		}
+		else
+		{
+			resourceDir = arg;
+		}
+	}
+
+	if ((benchmark || headless) && !debugLevelGiven)
+	{
+		debugLevel = GLSL::DebugLevel::Off;
 	}
 
+	CameraPath cameraPath;
+	if (benchmark)
+	{
+		if (cameraPathFile.empty())
+		{
+			cameraPathFile = resourceDir + "/benchmark_path.txt";
+		}
+		string errStr;
+		if (!cameraPath.load(cameraPathFile, errStr))
+		{
+			cerr << errStr << endl;
+			return EXIT_FAILURE;
+		}
+		// The path is played back at a fixed 60 frames per second
+		frameCount = warmupFrames + (long) ceil(cameraPath.duration() * 60.0f) + 1;
+	}
+
+	srand(seed);
 	Application *application = new Application();
+	application->rng.seed(seed);
 
 	// Your main will always include a similar set up to establish your window
 	// and GL context, etc.
 
 	WindowManager *windowManager = new WindowManager();
-	windowManager->init(640, 480);
+	if (!windowManager->init(width, height, debugLevel == GLSL::DebugLevel::Callback, !headless))
+	{
+		cerr << "Failed to create a GL context" << endl;
+		return EXIT_FAILURE;
+	}
+	GLSL::setDebugLevel(debugLevel);
 	windowManager->setEventCallbacks(application);
 	application->windowManager = windowManager;
 
+	Framebuffer *offscreen = nullptr;
+	if (headless)
+	{
+		windowManager->setVsync(false);
+		offscreen = new Framebuffer();
+		if (!offscreen->init(width, height))
+		{
+			return EXIT_FAILURE;
+		}
+		application->offscreen = offscreen;
+	}
+	if (benchmark)
+	{
+		windowManager->setVsync(false);
+	}
+
 	// This is the code that will likely change program to program as you
 	// may need to initialize or set up different data and state
 
+	// Meshes and textures are decoded on worker threads and uploaded a few
+	// at a time from the render loop
+	AssetLoader *assetLoader = new AssetLoader();
+	application->assetLoader = assetLoader;
+
 	application->init(resourceDir);
 	application->initGeom(resourceDir);
 	application->initTex(resourceDir);
 
+	// Headless and benchmark runs measure the finished scene, not the loading
+	const bool fixedLength = headless || benchmark;
+	if (fixedLength)
+	{
+		assetLoader->finish();
+	}
+	const double startTime = glfwGetTime();
+
+	BenchmarkReport report;
+	typedef chrono::steady_clock Clock;
+	Clock::time_point lastFrameEnd = Clock::now();
+
 	// Loop until the user closes the window.
 	while (! glfwWindowShouldClose(windowManager->getHandle()))
 	{
+		// Spend at most ~4ms of each frame on GL uploads
+		assetLoader->processUploads(0.004);
+
+		// Benchmarks drive the camera from the path, after warming up at
+		// its start
+		const long benchmarkFrame = application->frames - warmupFrames;
+		if (benchmark)
+		{
+			cameraPath.sample(max(benchmarkFrame, 0L) / 60.0f, application->eye, application->theta, application->phi);
+		}
+		const bool measured = benchmark && benchmarkFrame >= 0;
+		application->gpuProfiler.setRecording(measured);
+
 		// Render scene.
+		uint64_t allocationsBefore = HeapCounter::threadAllocations();
+		const Clock::time_point renderStart = Clock::now();
 		application->render();
+		const Clock::time_point renderEnd = Clock::now();
+		RenderStats::count(RenderStats::HeapAllocations, HeapCounter::threadAllocations() - allocationsBefore);
 
-		// Swap front and back buffers.
-		glfwSwapBuffers(windowManager->getHandle());
+		if (offscreen && !framePrefix.empty())
+		{
+			char number[16];
+			snprintf(number, sizeof(number), "%04ld.png", application->frames);
+			offscreen->writePNG(framePrefix + number);
+		}
+
+		// Swap front and back buffers; a hidden window is never presented
+		if (!headless)
+		{
+			PROFILE_SCOPE("glfwSwapBuffers");
+			glfwSwapBuffers(windowManager->getHandle());
+		}
 		// Poll for and process events.
 		glfwPollEvents();
-		
+
+		const Clock::time_point frameEnd = Clock::now();
+		if (measured)
+		{
+			report.addFrame(chrono::duration<double, milli>(frameEnd - lastFrameEnd).count(),
+				chrono::duration<double, milli>(renderEnd - renderStart).count(),
+				RenderStats::current());
+		}
+		lastFrameEnd = frameEnd;
+		RenderStats::endFrame();
+
 		application->frames++;
+		if (fixedLength && application->frames >= frameCount)
+		{
+			break;
+		}
+	}
+
+	if (headless)
+	{
+		// Wait for the GPU so the time covers every frame's work
+		glFinish();
+		const double seconds = glfwGetTime() - startTime;
+		cout << "Rendered " << application->frames << " frames at " << width << "x" << height << " in " << seconds << " s ("
+			<< 1000.0 * seconds / max(application->frames, 1L) << " ms/frame)" << endl;
+	}
+
+	if (benchmark)
+	{
+		GpuProfiler &gpuProfiler = application->gpuProfiler;
+		gpuProfiler.finish();
+		report.addGpuTimes(gpuProfiler.recordedTotals());
+		for (int i = 0; i < gpuProfiler.numPasses(); i++)
+		{
+			report.addGpuPass(gpuProfiler.passName(i), gpuProfiler.recordedTimes(i));
+		}
+
+		if (!offscreen)
+		{
+			glfwGetFramebufferSize(windowManager->getHandle(), &width, &height);
+		}
+		report.setField("seed", to_string(seed));
+		report.setField("width", to_string(width));
+		report.setField("height", to_string(height));
+		report.setField("headless", headless ? "true" : "false");
+		report.setField("vsync", "false");
+		report.setField("glDebug", string("\"") + GLSL::debugLevelName(GLSL::getDebugLevel()) + "\"");
+		report.setField("warmupFrames", to_string(warmupFrames));
+		report.setField("frames", to_string(application->frames - warmupFrames));
+
+		// A file, since stdout also carries the app's diagnostics
+		ofstream out(jsonFile);
+		report.writeJSON(out);
+		if (out)
+		{
+			cout << "Wrote benchmark report to " << jsonFile << endl;
+		}
+		else
+		{
+			cerr << "failed to write: " << jsonFile << endl;
+		}
 	}
 
 	// Quit program.
+	delete offscreen;
+	delete assetLoader;
+
+	// After the loader threads have stopped recording
+	if (!traceFile.empty())
+	{
+		Profiler::writeChromeTrace(traceFile);
+	}
 	windowManager->shutdown();
 	return 0;
 }
@@ -0,0 +1,197 @@
+/*
+ * Microbenchmark for the OBJ number parser.
+ *
+ * Pulls every numeric token out of the v/vn/vt records of the repo's OBJ
+ * files and times the old pow()-based tryParseDouble against the current
+ * parseNumber, then times a full tinyobj::LoadObj of each file.
+ *
+ * Usage: ObjParseBench [resource dir] [iterations]
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <tiny_obj_loader/tiny_obj_loader.h>
+
+using namespace std;
+
+namespace
+{
+
+const char *ObjFiles[] = {
+	"tree.obj", "dummy.obj", "terrain.obj", "bunny.obj", "dog.obj",
+	"sphere.obj", "SmoothSphere.obj", "cube.obj", "plane.obj"
+};
+
+struct Token
+{
+	size_t begin;
+	size_t end;
+};
+
+double elapsedMs(chrono::steady_clock::time_point start)
+{
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+// Collects the numeric fields of every v, vn and vt line
+void collectTokens(const string &text, vector<Token> &tokens)
+{
+	istringstream lines(text);
+	string line;
+	size_t lineStart = 0;
+	while (getline(lines, line))
+	{
+		const char *p = line.c_str();
+		p += strspn(p, " \t");
+		if (p[0] == 'v' && (p[1] == ' ' || p[1] == 't' || p[1] == 'n'))
+		{
+			p += strcspn(p, " \t");
+			while (true)
+			{
+				p += strspn(p, " \t");
+				size_t len = strcspn(p, " \t\r");
+				if (len == 0)
+				{
+					break;
+				}
+				size_t offset = lineStart + (size_t)(p - line.c_str());
+				tokens.push_back({ offset, offset + len });
+				p += len;
+			}
+		}
+		lineStart += line.size() + 1;
+	}
+}
+
+uint32_t floatBits(float f)
+{
+	uint32_t u;
+	memcpy(&u, &f, sizeof(u));
+	return u;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+	std::string resourceDir = "../resources";
+	int iterations = 20;
+
+	if (argc >= 2)
+	{
+		resourceDir = argv[1];
+	}
+	if (argc >= 3)
+	{
+		iterations = atoi(argv[2]);
+	}
+
+	string text;
+	vector<Token> tokens;
+	for (const char *name : ObjFiles)
+	{
+		ifstream file(resourceDir + "/" + name, ios::binary);
+		if (!file)
+		{
+			cerr << "Skipping missing " << name << endl;
+			continue;
+		}
+		string contents((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+		contents += '\n';
+		size_t base = text.size();
+		vector<Token> fileTokens;
+		collectTokens(contents, fileTokens);
+		for (Token &t : fileTokens)
+		{
+			tokens.push_back({ base + t.begin, base + t.end });
+		}
+		text += contents;
+	}
+
+	if (tokens.empty())
+	{
+		cerr << "No OBJ data found in " << resourceDir << endl;
+		return 1;
+	}
+
+	const char *data = text.c_str();
+	vector<float> oldValues(tokens.size());
+	vector<float> newValues(tokens.size());
+
+	auto start = chrono::steady_clock::now();
+	for (int it = 0; it < iterations; it++)
+	{
+		for (size_t i = 0; i < tokens.size(); i++)
+		{
+			double val = 0.0;
+			tinyobj::tryParseDouble(data + tokens[i].begin, data + tokens[i].end, &val);
+			oldValues[i] = static_cast<float>(val);
+		}
+	}
+	double oldMs = elapsedMs(start);
+
+	start = chrono::steady_clock::now();
+	for (int it = 0; it < iterations; it++)
+	{
+		for (size_t i = 0; i < tokens.size(); i++)
+		{
+			double val = 0.0;
+			tinyobj::parseNumber(data + tokens[i].begin, data + tokens[i].end, &val);
+			newValues[i] = static_cast<float>(val);
+		}
+	}
+	double newMs = elapsedMs(start);
+
+	// The old parser rounds inexactly, so a last-bit difference is expected
+	size_t mismatches = 0;
+	uint32_t maxUlp = 0;
+	for (size_t i = 0; i < tokens.size(); i++)
+	{
+		if (oldValues[i] != newValues[i])
+		{
+			mismatches++;
+			uint32_t a = floatBits(oldValues[i]);
+			uint32_t b = floatBits(newValues[i]);
+			uint32_t ulp = a > b ? a - b : b - a;
+			if (ulp > maxUlp)
+			{
+				maxUlp = ulp;
+			}
+		}
+	}
+
+	const double calls = double(tokens.size()) * iterations;
+	cout << fixed << setprecision(2);
+	cout << tokens.size() << " tokens x " << iterations << " iterations" << endl;
+	cout << "tryParseDouble: " << oldMs << " ms (" << oldMs * 1e6 / calls << " ns/token)" << endl;
+	cout << "parseNumber:    " << newMs << " ms (" << newMs * 1e6 / calls << " ns/token)" << endl;
+	cout << "speedup:        " << oldMs / newMs << "x" << endl;
+	cout << "differing:      " << mismatches << " (max " << maxUlp << " ulp)" << endl;
+
+	cout << endl << "LoadObj" << endl;
+	for (const char *name : ObjFiles)
+	{
+		const string path = resourceDir + "/" + name;
+		vector<tinyobj::shape_t> shapes;
+		vector<tinyobj::material_t> materials;
+		string err;
+
+		start = chrono::steady_clock::now();
+		if (!tinyobj::LoadObj(shapes, materials, err, path.c_str()))
+		{
+			continue;
+		}
+		double ms = elapsedMs(start);
+
+		cout << "  " << setw(18) << left << name << right << setw(9) << ms << " ms" << endl;
+	}
+
+	return 0;
+}